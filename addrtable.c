@@ -0,0 +1,174 @@
+#include <cnet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addrtable.h"
+
+/*  A hash table keyed by node address, see addrtable.h.
+
+    The keys and the used flags are kept apart from the values, so probing
+    for a key reads a few bytes of one cache line rather than striding over
+    whole entries. Addresses are hashed by multiplying with 2^32 / phi and
+    keeping the top bits (Fibonacci hashing), which spreads the small,
+    consecutive addresses cnet hands out across the table.
+ */
+
+#define ADDRTABLE_MIN_CAPACITY  16
+
+#define VALUE(t, i)     ((t)->values + (size_t)(i) * (t)->valuesize)
+
+
+//  THE SLOT WHERE THE SEARCH FOR addr STARTS
+static int home_slot(ADDRTABLE *t, CnetAddr addr)
+{
+    return (int)(((uint32_t)addr * 2654435769u) >> t->shift);
+}
+
+//  THE SLOT HOLDING addr, OR -1
+static int find_slot(ADDRTABLE *t, CnetAddr addr)
+{
+    int     mask = t->capacity - 1;
+
+    if (t->capacity == 0){
+        return -1;
+    }
+    for (int i = home_slot(t, addr); t->used[i]; i = (i + 1) & mask){
+        if (t->keys[i] == addr){
+            return i;
+        }
+    }
+    return -1;
+}
+
+//  MOVE EVERY ENTRY INTO A TABLE OF newcapacity SLOTS, RETURN 0 ON SUCCESS
+static int resize(ADDRTABLE *t, int newcapacity)
+{
+    ADDRTABLE   old = *t;
+    int         bits = 0;
+
+    while ((1 << bits) < newcapacity){
+        bits++;
+    }
+    t->keys = malloc(newcapacity * sizeof(CnetAddr));
+    t->used = calloc(newcapacity, 1);
+    t->values = malloc(newcapacity * t->valuesize);
+    if (t->keys == NULL || t->used == NULL || t->values == NULL){
+        free(t->keys);
+        free(t->used);
+        free(t->values);
+        *t = old;
+        return -1;
+    }
+    t->capacity = newcapacity;
+    t->shift = 32 - bits;
+    t->count = 0;
+
+    for (int i = 0; i < old.capacity; i++){
+        if (old.used[i]){
+            int mask = t->capacity - 1;
+            int j = home_slot(t, old.keys[i]);
+
+            while (t->used[j]){
+                j = (j + 1) & mask;
+            }
+            t->keys[j] = old.keys[i];
+            t->used[j] = 1;
+            memcpy(VALUE(t, j), VALUE(&old, i), t->valuesize);
+            t->count++;
+        }
+    }
+    free(old.keys);
+    free(old.used);
+    free(old.values);
+    return 0;
+}
+
+void ADDRTABLE_init(ADDRTABLE *t, size_t valuesize)
+{
+    memset(t, 0, sizeof(ADDRTABLE));
+    t->valuesize = valuesize;
+}
+
+void ADDRTABLE_free(ADDRTABLE *t)
+{
+    free(t->keys);
+    free(t->used);
+    free(t->values);
+    ADDRTABLE_init(t, t->valuesize);
+}
+
+void *ADDRTABLE_find(ADDRTABLE *t, CnetAddr addr)
+{
+    int     i = find_slot(t, addr);
+
+    return (i < 0) ? NULL : VALUE(t, i);
+}
+
+void *ADDRTABLE_insert(ADDRTABLE *t, CnetAddr addr)
+{
+    int     i = find_slot(t, addr);
+    int     mask;
+
+    if (i >= 0){
+        return VALUE(t, i);
+    }
+    // keep the table at most 3/4 full so probe sequences stay short
+    if ((t->count + 1) * 4 > t->capacity * 3){
+        if (resize(t, t->capacity ? 2 * t->capacity : ADDRTABLE_MIN_CAPACITY) != 0){
+            return NULL;
+        }
+    }
+    mask = t->capacity - 1;
+    for (i = home_slot(t, addr); t->used[i]; i = (i + 1) & mask){
+        ;
+    }
+    t->keys[i] = addr;
+    t->used[i] = 1;
+    memset(VALUE(t, i), 0, t->valuesize);
+    t->count++;
+    return VALUE(t, i);
+}
+
+int ADDRTABLE_remove(ADDRTABLE *t, CnetAddr addr)
+{
+    int     i = find_slot(t, addr);
+    int     mask = t->capacity - 1;
+
+    if (i < 0){
+        return 0;
+    }
+    t->used[i] = 0;
+    t->count--;
+
+    // shift back any later entry of the same run that can no longer be reached past the hole
+    for (int j = (i + 1) & mask; t->used[j]; j = (j + 1) & mask){
+        int k = home_slot(t, t->keys[j]);
+
+        // the entry stays put if its home slot lies cyclically in (i, j]
+        if ((i < j) ? (i < k && k <= j) : (i < k || k <= j)){
+            continue;
+        }
+        t->keys[i] = t->keys[j];
+        t->used[i] = 1;
+        memcpy(VALUE(t, i), VALUE(t, j), t->valuesize);
+        t->used[j] = 0;
+        i = j;
+    }
+    return 1;
+}
+
+void *ADDRTABLE_next(ADDRTABLE *t, int *slot, CnetAddr *addr)
+{
+    while (*slot < t->capacity){
+        int i = (*slot)++;
+
+        if (t->used[i]){
+            if (addr != NULL){
+                *addr = t->keys[i];
+            }
+            return VALUE(t, i);
+        }
+    }
+    return NULL;
+}
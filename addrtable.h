@@ -0,0 +1,49 @@
+#ifndef _ADDRTABLE_H
+#define _ADDRTABLE_H
+
+#include <cnet.h>
+#include <stddef.h>
+
+/*  A hash table keyed by node address, for forwarding tables and other
+    per-host state.
+
+    Each entry holds a fixed-size value, stored inline. The table uses open
+    addressing with linear probing, so a lookup usually touches one or two
+    adjacent slots, and doubles in size whenever it gets 3/4 full, so there
+    is no limit on the number of hosts.
+
+    A table that is all zeroes is empty and usable once ADDRTABLE_init()
+    has given it its value size. Pointers returned by ADDRTABLE_find() and
+    ADDRTABLE_insert() stay valid only until the next insert or remove.
+ */
+
+typedef struct {
+    CnetAddr        *keys;
+    unsigned char   *used;      // 1 if the slot holds an entry
+    unsigned char   *values;    // valuesize bytes per slot
+    size_t          valuesize;
+    int             capacity;   // the number of slots, 0 or a power of 2
+    int             shift;      // 32 - log2(capacity), for the hash
+    int             count;      // the number of entries
+} ADDRTABLE;
+
+//  PREPARE AN EMPTY TABLE WHOSE VALUES ARE valuesize BYTES LONG
+extern  void    ADDRTABLE_init(ADDRTABLE *t, size_t valuesize);
+
+//  RELEASE THE MEMORY OF A TABLE, LEAVING IT EMPTY
+extern  void    ADDRTABLE_free(ADDRTABLE *t);
+
+//  THE VALUE STORED FOR addr, OR NULL IF THERE IS NONE
+extern  void    *ADDRTABLE_find(ADDRTABLE *t, CnetAddr addr);
+
+//  THE VALUE STORED FOR addr, ADDING A ZEROED ONE IF THERE IS NONE, NULL IF OUT OF MEMORY
+extern  void    *ADDRTABLE_insert(ADDRTABLE *t, CnetAddr addr);
+
+//  REMOVE THE ENTRY FOR addr, RETURN 1 IF THERE WAS ONE
+extern  int     ADDRTABLE_remove(ADDRTABLE *t, CnetAddr addr);
+
+//  STEP THROUGH THE ENTRIES: START WITH *slot = 0, EACH CALL RETURNS THE NEXT VALUE
+//  AND ITS ADDRESS IN *addr, OR NULL WHEN THERE ARE NO MORE
+extern  void    *ADDRTABLE_next(ADDRTABLE *t, int *slot, CnetAddr *addr);
+
+#endif
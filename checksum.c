@@ -0,0 +1,196 @@
+#ifndef CHECKSUM_BENCH
+#include <cnet.h>
+#else
+extern int CNET_ccitt(unsigned char *addr, int nbytes);
+#endif
+#include <string.h>
+
+#include "checksum.h"
+
+/*  The frame checksums used by the protocols, see checksum.h.
+
+    crc32c_sw() is Intel's slicing-by-8 algorithm: table[k][b] is the CRC of
+    byte b followed by k zero bytes, so eight table lookups fold 8 bytes into
+    the CRC at once instead of one byte per lookup.
+
+    crc32c_hw() uses the SSE4.2 crc32 instruction, 8 bytes per instruction.
+    It is compiled for SSE4.2 whatever the build flags, and crc32c() only
+    calls it after asking the CPU whether it has the instruction.
+
+    inet_checksum() is the one's complement sum used for frame headers.
+    Unlike a CRC it can be patched when a field changes, which lets a
+    router bump a hop count without reading the rest of the frame.
+ */
+
+//  THE CRC-32C POLYNOMIAL, BIT-REVERSED
+#define CRC32C_POLY         0x82F63B78
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HAVE_HW      1
+#include <nmmintrin.h>
+#else
+#define CRC32C_HAVE_HW      0
+#endif
+
+static  uint32_t    crc32c_table[8][256];
+static  int         crc32c_table_ready = 0;
+
+//  THE VARIANT crc32c() CALLS, CHOSEN ON FIRST USE
+static  uint32_t    (*crc32c_impl)(uint32_t, const void *, size_t) = NULL;
+
+
+//  BUILD THE SLICING-BY-8 TABLES
+static void crc32c_init_table(void)
+{
+    for (int b = 0; b < 256; b++){
+        uint32_t crc = b;
+
+        for (int i = 0; i < 8; i++){
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[0][b] = crc;
+    }
+    for (int b = 0; b < 256; b++){
+        for (int k = 1; k < 8; k++){
+            uint32_t prev = crc32c_table[k - 1][b];
+
+            crc32c_table[k][b] = (prev >> 8) ^ crc32c_table[0][prev & 0xff];
+        }
+    }
+    crc32c_table_ready = 1;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *addr, size_t nbytes)
+{
+    const unsigned char *p = addr;
+
+    if (!crc32c_table_ready){
+        crc32c_init_table();
+    }
+    crc = ~crc;
+    while (nbytes >= 8){
+        // the bytes are combined one at a time, so this works whatever the byte order
+        uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+
+        crc = crc32c_table[7][lo & 0xff] ^
+              crc32c_table[6][(lo >> 8) & 0xff] ^
+              crc32c_table[5][(lo >> 16) & 0xff] ^
+              crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^
+              crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^
+              crc32c_table[0][p[7]];
+        p += 8;
+        nbytes -= 8;
+    }
+    while (nbytes-- > 0){
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+#if CRC32C_HAVE_HW
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const void *addr, size_t nbytes)
+{
+    const unsigned char *p = addr;
+    uint64_t    c = ~crc;
+
+    // line up on 8 bytes, then take them 8 at a time
+    while (nbytes > 0 && ((uintptr_t)p & 7) != 0){
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        nbytes--;
+    }
+    while (nbytes >= 8){
+        uint64_t w;
+
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        nbytes -= 8;
+    }
+    while (nbytes-- > 0){
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    return ~(uint32_t)c;
+}
+
+int crc32c_hw_available(void)
+{
+    return __builtin_cpu_supports("sse4.2") != 0;
+}
+
+#else
+uint32_t crc32c_hw(uint32_t crc, const void *addr, size_t nbytes)
+{
+    return crc32c_sw(crc, addr, nbytes);
+}
+
+int crc32c_hw_available(void)
+{
+    return 0;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *addr, size_t nbytes)
+{
+    if (crc32c_impl == NULL){
+        crc32c_impl = crc32c_hw_available() ? crc32c_hw : crc32c_sw;
+    }
+    return crc32c_impl(crc, addr, nbytes);
+}
+
+int checksum(const void *addr, size_t nbytes)
+{
+#if CHECKSUM_ALGO == CHECKSUM_CCITT
+    return CNET_ccitt((unsigned char *)addr, (int)nbytes);
+#else
+    return (int)crc32c(0, addr, nbytes);
+#endif
+}
+
+const char *checksum_name(void)
+{
+#if CHECKSUM_ALGO == CHECKSUM_CCITT
+    return "ccitt";
+#else
+    return crc32c_hw_available() ? "crc32c-sse4.2" : "crc32c-slicing-by-8";
+#endif
+}
+
+uint16_t inet_checksum(const void *addr, size_t nbytes)
+{
+    const unsigned char *p = addr;
+    uint32_t    sum = 0;
+    uint16_t    word;
+
+    // the sum of 16-bit words in memory order gives the same checksum on either byte order
+    while (nbytes >= 2){
+        memcpy(&word, p, 2);
+        sum += word;
+        p += 2;
+        nbytes -= 2;
+    }
+    if (nbytes > 0){
+        word = 0;
+        memcpy(&word, p, 1);
+        sum += word;
+    }
+    while (sum >> 16){
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+uint16_t inet_checksum_update(uint16_t sum, uint32_t oldval, uint32_t newval)
+{
+    // HC' = ~(~HC + ~m + m') for each 16-bit half of the field
+    uint32_t    s = (uint16_t)~sum;
+
+    s += (uint16_t)~(oldval & 0xffff) + (newval & 0xffff);
+    s += (uint16_t)~(oldval >> 16) + (newval >> 16);
+    while (s >> 16){
+        s = (s & 0xffff) + (s >> 16);
+    }
+    return (uint16_t)~s;
+}
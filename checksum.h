@@ -0,0 +1,52 @@
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*  A pluggable frame checksum.
+
+    The algorithm is chosen when the protocol is built, by adding e.g.
+    -DCHECKSUM_ALGO=CHECKSUM_CCITT to CNETCFLAGS:
+
+    CHECKSUM_CRC32C   CRC-32C (Castagnoli), the default. It uses the SSE4.2
+                      crc32 instruction when the CPU has one, and otherwise
+                      a slicing-by-8 table that handles 8 bytes per step.
+    CHECKSUM_CCITT    cnet's own 16-bit CNET_ccitt, one byte per step, for
+                      talking to nodes built before this module existed.
+
+    Both ends of a link must be built with the same algorithm.
+ */
+
+#define CHECKSUM_CCITT      0
+#define CHECKSUM_CRC32C     1
+
+#ifndef CHECKSUM_ALGO
+#define CHECKSUM_ALGO       CHECKSUM_CRC32C
+#endif
+
+//  THE CHECKSUM OF nbytes BYTES AT addr, WITH THE ALGORITHM CHOSEN FOR THIS BUILD
+extern  int         checksum(const void *addr, size_t nbytes);
+
+//  THE NAME OF THE ALGORITHM checksum() USES, FOR REPORTS
+extern  const char  *checksum_name(void);
+
+//  CRC-32C, CONTINUING FROM crc (0 TO START), USING THE FASTEST VARIANT THIS CPU SUPPORTS
+extern  uint32_t    crc32c(uint32_t crc, const void *addr, size_t nbytes);
+
+//  THE PORTABLE SLICING-BY-8 VARIANT
+extern  uint32_t    crc32c_sw(uint32_t crc, const void *addr, size_t nbytes);
+
+//  THE SSE4.2 VARIANT, ONLY TO BE CALLED IF crc32c_hw_available() RETURNS 1
+extern  uint32_t    crc32c_hw(uint32_t crc, const void *addr, size_t nbytes);
+extern  int         crc32c_hw_available(void);
+
+//  THE 16-BIT ONE'S COMPLEMENT INTERNET CHECKSUM (RFC 1071) OF nbytes BYTES AT addr.
+//  SUMMING A BLOCK THAT ALREADY HOLDS ITS OWN CORRECT CHECKSUM GIVES 0
+extern  uint16_t    inet_checksum(const void *addr, size_t nbytes);
+
+//  UPDATE AN INTERNET CHECKSUM FOR ONE 32-BIT FIELD CHANGING FROM oldval TO newval (RFC 1624),
+//  WITHOUT LOOKING AT THE REST OF THE BLOCK
+extern  uint16_t    inet_checksum_update(uint16_t sum, uint32_t oldval, uint32_t newval);
+
+#endif
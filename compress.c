@@ -0,0 +1,241 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "compress.h"
+
+/*  The compression stage for application messages, see compress.h.
+
+    The LZ format is a run of sequences, each a token byte, its literals,
+    and a match:
+
+        token       the high 4 bits are the number of literals, the low 4
+                    bits the match length less LZ_MIN_MATCH. 15 in either
+                    means more follows, in bytes of 255 until one is less
+        literals    copied as they are
+        offset      2 bytes, little-endian, how far back the match starts
+        match       the extra bytes of a long match length
+
+    The last sequence has no match, and ends with the input. A match may
+    overlap the bytes it produces, which is how a run is coded.
+
+    The compressor keeps the last place each hash of 4 bytes was seen.
+    When a place has no match it moves on by more and more, one byte
+    further for every LZ_SKIP_SHIFT bytes in a row without one, so it
+    passes over data that does not compress almost as fast as it reads it.
+ */
+
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       65535
+#define LZ_HASH_BITS        12
+#define LZ_SKIP_SHIFT       5
+
+//  THE LAST BYTES ARE ALWAYS LITERALS, SO A 4-BYTE READ AT A MATCH NEVER RUNS OFF THE END
+#define LZ_LAST_LITERALS    5
+
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t    v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t lz_hash(const uint8_t *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//  WRITE THE REST OF A LENGTH THAT DID NOT FIT IN ITS 4 BITS, RETURN NULL IF IT RUNS PAST end
+static uint8_t *put_length(uint8_t *op, uint8_t *end, size_t n)
+{
+    while (n >= 255){
+        if (op >= end){
+            return NULL;
+        }
+        *op++ = 255;
+        n -= 255;
+    }
+    if (op >= end){
+        return NULL;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+//  WRITE ONE SEQUENCE, ITS MATCH LEFT OUT IF matchlen IS 0, RETURN NULL IF IT RUNS PAST end
+static uint8_t *put_sequence(uint8_t *op, uint8_t *end, const uint8_t *lit, size_t litlen,
+                             size_t offset, size_t matchlen)
+{
+    uint8_t     *token = op++;
+    size_t      ml = matchlen ? matchlen - LZ_MIN_MATCH : 0;
+
+    if (token >= end){
+        return NULL;
+    }
+    *token = (uint8_t)(((litlen < 15 ? litlen : 15) << 4) | (ml < 15 ? ml : 15));
+    if (litlen >= 15 && (op = put_length(op, end, litlen - 15)) == NULL){
+        return NULL;
+    }
+    if ((size_t)(end - op) < litlen){
+        return NULL;
+    }
+    memcpy(op, lit, litlen);
+    op += litlen;
+    if (matchlen == 0){
+        return op;
+    }
+    if (end - op < 2){
+        return NULL;
+    }
+    *op++ = offset & 0xff;
+    *op++ = (offset >> 8) & 0xff;
+    if (ml >= 15 && (op = put_length(op, end, ml - 15)) == NULL){
+        return NULL;
+    }
+    return op;
+}
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t dstmax)
+{
+    const uint8_t   *base = src, *ip = base, *anchor = base;
+    const uint8_t   *limit = base + (len > LZ_LAST_LITERALS ? len - LZ_LAST_LITERALS : 0);
+    const uint8_t   *end = base + len;
+    uint8_t         *op = dst, *opend = op + dstmax;
+    uint32_t        table[1 << LZ_HASH_BITS];   // 1 + the place each hash was last seen, 0 for none
+    size_t          misses = 0;
+
+    memset(table, 0, sizeof(table));
+    while (ip + LZ_MIN_MATCH <= limit){
+        uint32_t        h = lz_hash(ip);
+        const uint8_t   *ref = table[h] ? base + table[h] - 1 : NULL;
+        const uint8_t   *mp;
+
+        table[h] = (uint32_t)(ip - base) + 1;
+        if (ref == NULL || ip - ref > LZ_MAX_OFFSET || read32(ref) != read32(ip)){
+            ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+            continue;
+        }
+        misses = 0;
+        // take the match back over literals that match too, then as far forward as it goes
+        while (ip > anchor && ref > base && ip[-1] == ref[-1]){
+            ip--;
+            ref--;
+        }
+        mp = ip + LZ_MIN_MATCH;
+        while (mp < limit && *mp == ref[mp - ip]){
+            mp++;
+        }
+        op = put_sequence(op, opend, anchor, ip - anchor, ip - ref, mp - ip);
+        if (op == NULL){
+            return 0;
+        }
+        ip = anchor = mp;
+        if (ip - 2 >= base && ip - 2 + LZ_MIN_MATCH <= limit){
+            // so a repeat straight after the match is found
+            table[lz_hash(ip - 2)] = (uint32_t)(ip - 2 - base) + 1;
+        }
+    }
+    op = put_sequence(op, opend, anchor, end - anchor, 0, 0);
+    return (op == NULL) ? 0 : (size_t)(op - (uint8_t *)dst);
+}
+
+//  READ THE REST OF A LENGTH THAT DID NOT FIT IN ITS 4 BITS, RETURN -1 IF THE INPUT ENDS FIRST
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *n)
+{
+    uint8_t     b;
+
+    do {
+        if (*ip >= end){
+            return -1;
+        }
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+long lz_decompress(const void *src, size_t len, void *dst, size_t dstmax)
+{
+    const uint8_t   *ip = src, *end = ip + len;
+    uint8_t         *base = dst, *op = base, *opend = base + dstmax;
+
+    while (ip < end){
+        uint8_t     token = *ip++;
+        size_t      litlen = token >> 4, matchlen = token & 15, offset;
+
+        if (litlen == 15 && get_length(&ip, end, &litlen) != 0){
+            return -1;
+        }
+        if ((size_t)(end - ip) < litlen || (size_t)(opend - op) < litlen){
+            return -1;
+        }
+        memcpy(op, ip, litlen);
+        ip += litlen;
+        op += litlen;
+        if (ip == end){
+            break;            // the last sequence
+        }
+        if (end - ip < 2){
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (matchlen == 15 && get_length(&ip, end, &matchlen) != 0){
+            return -1;
+        }
+        matchlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - base) || (size_t)(opend - op) < matchlen){
+            return -1;
+        }
+        // byte by byte, as the match may overlap what it writes
+        for (const uint8_t *mp = op - offset; matchlen > 0; matchlen--){
+            *op++ = *mp++;
+        }
+    }
+    return (long)(op - base);
+}
+
+CODEC compress_message(const void *src, size_t len, void *dst, size_t *dstlen)
+{
+    size_t  n;
+
+    if (COMPRESS_ALGO == COMPRESS_NONE || len < COMPRESS_MIN_LEN){
+        return CODEC_STORE;
+    }
+    n = lz_compress(src, len, dst, len - len / COMPRESS_MIN_GAIN);
+    if (n == 0){
+        return CODEC_STORE;
+    }
+    *dstlen = n;
+    return CODEC_LZ;
+}
+
+int decompress_message(CODEC codec, const void *src, size_t len, void *dst, size_t *dstlen)
+{
+    long    n;
+
+    switch (codec){
+    case CODEC_STORE:
+        if (len > *dstlen){
+            return -1;
+        }
+        memcpy(dst, src, len);
+        *dstlen = len;
+        return 0;
+    case CODEC_LZ:
+        n = lz_decompress(src, len, dst, *dstlen);
+        if (n < 0){
+            return -1;
+        }
+        *dstlen = (size_t)n;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+const char *compress_name(void)
+{
+    return (COMPRESS_ALGO == COMPRESS_NONE) ? "none" : "lz";
+}
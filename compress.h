@@ -0,0 +1,67 @@
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include <stddef.h>
+
+/*  A pluggable compression stage for application messages.
+
+    The codec is chosen when the protocol is built, by adding e.g.
+    -DCOMPRESS_ALGO=COMPRESS_NONE to CNETCFLAGS:
+
+    COMPRESS_LZ       an LZ77 codec in the style of LZ4, the default. It
+                      finds repeats through a hash of the next 4 bytes
+                      and codes them as a length and an offset back, with
+                      no entropy coding, so it costs little more than a
+                      copy either way.
+    COMPRESS_NONE     every message is stored as it is.
+
+    Each message is tried on its own. The codec's output is only kept if
+    it is at least 1/COMPRESS_MIN_GAIN shorter than the message, otherwise
+    the message is stored, and the codec gives up as soon as its output
+    runs past that, so a message with nothing to compress, such as random
+    bytes, costs little to try. The frames of a message say how it was
+    carried, so both ends need not be built with the same codec.
+ */
+
+#define COMPRESS_NONE       0
+#define COMPRESS_LZ         1
+
+#ifndef COMPRESS_ALGO
+#define COMPRESS_ALGO       COMPRESS_LZ
+#endif
+
+//  A MESSAGE IS ONLY SENT COMPRESSED IF THAT SAVES AT LEAST 1/COMPRESS_MIN_GAIN OF IT
+#ifndef COMPRESS_MIN_GAIN
+#define COMPRESS_MIN_GAIN   16
+#endif
+
+//  MESSAGES SHORTER THAN THIS ARE ALWAYS STORED
+#define COMPRESS_MIN_LEN    64
+
+//  HOW A MESSAGE IS CARRIED
+typedef enum {
+    CODEC_STORE,        // as it is
+    CODEC_LZ,           // compressed by lz_compress()
+    N_CODECS
+} CODEC;
+
+//  COMPRESS len BYTES AT src INTO dst, WHICH HAS ROOM FOR len BYTES, WITH THE CODEC CHOSEN FOR
+//  THIS BUILD, AND SET *dstlen. RETURN CODEC_STORE, WITH dst UNDEFINED, IF THAT WOULD NOT SAVE ENOUGH
+extern  CODEC       compress_message(const void *src, size_t len, void *dst, size_t *dstlen);
+
+//  UNDO compress_message() FOR A MESSAGE CARRIED WITH codec. *dstlen IS THE ROOM AT dst, AND IS
+//  SET TO THE LENGTH OF THE MESSAGE. RETURN -1 IF THE DATA IS DAMAGED OR DOES NOT FIT
+extern  int         decompress_message(CODEC codec, const void *src, size_t len, void *dst, size_t *dstlen);
+
+//  THE NAME OF THE CODEC compress_message() TRIES, FOR REPORTS
+extern  const char  *compress_name(void);
+
+//  LZ COMPRESS len BYTES AT src INTO AT MOST dstmax BYTES AT dst, RETURN THE LENGTH, OR 0 IF IT
+//  WOULD NOT FIT
+extern  size_t      lz_compress(const void *src, size_t len, void *dst, size_t dstmax);
+
+//  LZ DECOMPRESS len BYTES AT src INTO AT MOST dstmax BYTES AT dst, RETURN THE LENGTH, OR -1 IF
+//  THE DATA IS DAMAGED OR WOULD NOT FIT
+extern  long        lz_decompress(const void *src, size_t len, void *dst, size_t dstmax);
+
+#endif
@@ -0,0 +1,38 @@
+#include "dupwindow.h"
+
+/*  A duplicate detection window, see dupwindow.h.
+
+    Sequence numbers are compared with serial number arithmetic (RFC 1982):
+    seq is ahead of top if (seq - top) mod 2^bits is less than half the
+    sequence space. With small sequence spaces the window shrinks to half
+    the space, so that ahead and behind can never be confused.
+ */
+
+void DUPWINDOW_init(DUPWINDOW *w, int bits)
+{
+    w->mask = (bits >= 32) ? 0xffffffffu : ((1u << bits) - 1);
+    // pretend everything before 0 has been seen, so 0 is the first new number
+    w->top = w->mask;
+    w->seen = ~(uint64_t)0;
+}
+
+int DUPWINDOW_accept(DUPWINDOW *w, uint32_t seq)
+{
+    uint32_t    half = (w->mask >> 1) + 1;
+    uint32_t    size = (half < DUPWINDOW_SIZE) ? half : DUPWINDOW_SIZE;
+    uint32_t    ahead = (seq - w->top) & w->mask;
+    uint32_t    behind = (w->top - seq) & w->mask;
+
+    if (ahead != 0 && ahead < half){
+        // a new highest, slide the window up to it
+        w->seen = (ahead >= DUPWINDOW_SIZE) ? 0 : w->seen << ahead;
+        w->seen |= 1;
+        w->top = seq & w->mask;
+        return 1;
+    }
+    if (behind >= size || (w->seen >> behind) & 1){
+        return 0;
+    }
+    w->seen |= (uint64_t)1 << behind;
+    return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef _DUPWINDOW_H
+#define _DUPWINDOW_H
+
+#include <stdint.h>
+
+/*  A duplicate detection window for the frames from one source.
+
+    A receiver keeps one DUPWINDOW for each host it hears from. It records
+    the highest sequence number accepted so far and, in a 64-bit bitmap,
+    which of the DUPWINDOW_SIZE sequence numbers below it have been seen.
+    Deciding whether a frame is new is a shift and a test, whatever the
+    size of its payload, and the payload is never looked at.
+
+    Sequence numbers count up modulo 2^bits, with bits given to
+    DUPWINDOW_init(), and wrap around. A number up to half the sequence
+    space ahead of the highest is new, and slides the window up. One that
+    falls below the window is too old to tell apart from a duplicate, and
+    is treated as one.
+ */
+
+//  HOW MANY SEQUENCE NUMBERS BELOW THE HIGHEST ARE REMEMBERED
+#define DUPWINDOW_SIZE      64
+
+typedef struct {
+    uint32_t    mask;   // 2^bits - 1
+    uint32_t    top;    // the highest sequence number accepted
+    uint64_t    seen;   // bit d is set if top - d has been accepted
+} DUPWINDOW;
+
+//  AN EMPTY WINDOW FOR SEQUENCE NUMBERS OF bits BITS, 1 TO 32, EXPECTING 0 FIRST
+extern  void    DUPWINDOW_init(DUPWINDOW *w, int bits);
+
+//  RETURN 1 AND RECORD seq IF IT HAS NOT BEEN SEEN BEFORE, 0 IF IT IS A DUPLICATE OR TOO OLD
+extern  int     DUPWINDOW_accept(DUPWINDOW *w, uint32_t seq);
+
+#endif
@@ -0,0 +1,204 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addrtable.h"
+#include "dvroute.h"
+#include "trace.h"
+
+/*  Distance-vector routing, see dvroute.h.
+
+    This is the Bellman-Ford scheme of RIP. A neighbour's distance plus one
+    replaces ours if it is shorter, and always replaces ours if the
+    neighbour is the one we route through, since it knows better than we do
+    when its own route gets longer or goes away.
+ */
+
+//  THE TIMER DATA SAYS WHICH KIND OF UPDATE IS DUE
+#define DV_PERIODIC         0
+#define DV_TRIGGERED        1
+
+typedef struct {
+    int         link;       // 0 for this node
+    int         distance;   // in hops, DV_INFINITY once the route has gone
+    CnetTime    updated;    // when it was last heard, or when it went
+} DVROUTE;
+
+static  ADDRTABLE       routes;
+static  DVROUTE_SEND    send_update;
+static  CnetTimerID     trigger_timer   = NULLTIMER;
+
+
+//  SEND THE WHOLE TABLE ON link, POISONING THE ROUTES THAT WERE LEARNED THERE
+static void advertise(int link)
+{
+    unsigned char   update[DV_MAX_UPDATE];
+    size_t          len = 0;
+    DVROUTE         *r;
+    CnetAddr        addr;
+    int             slot = 0;
+
+    while ((r = ADDRTABLE_next(&routes, &slot, &addr)) != NULL){
+        unsigned char *e = &update[len];
+
+        e[0] = (addr >> 24) & 0xff;
+        e[1] = (addr >> 16) & 0xff;
+        e[2] = (addr >> 8) & 0xff;
+        e[3] = addr & 0xff;
+        e[4] = (r->link == link) ? DV_INFINITY : r->distance;
+        len += DV_ENTRY_SIZE;
+        if (len == DV_MAX_UPDATE){
+            send_update(link, update, len);
+            len = 0;
+        }
+    }
+    if (len > 0){
+        send_update(link, update, len);
+    }
+}
+
+//  SEND AN UPDATE SOON, SO THAT A BURST OF CHANGES GOES IN ONE UPDATE
+static void trigger(void)
+{
+    if (trigger_timer == NULLTIMER){
+        trigger_timer = CNET_start_timer(DV_TIMER, DV_TRIGGER_DELAY, DV_TRIGGERED);
+    }
+}
+
+//  MARK ROUTES THAT HAVE NOT BEEN HEARD FOR DV_TIMEOUT AS GONE, AND FORGET ONES THAT WENT DV_TIMEOUT AGO
+static void expire_routes(void)
+{
+    CnetTime    now = nodeinfo.time_in_usec;
+    DVROUTE     *r;
+    CnetAddr    addr;
+    int         slot = 0;
+
+    while ((r = ADDRTABLE_next(&routes, &slot, &addr)) != NULL){
+        if (r->link == 0 || now - r->updated < DV_TIMEOUT){
+            continue;
+        }
+        if (r->distance < DV_INFINITY){
+            LOG(LOG_INFO, "route to %d expired\n", addr);
+            r->distance = DV_INFINITY;
+            r->updated = now;
+            trigger();
+        }
+        else {
+            // removing moves later entries back, so start the scan again
+            ADDRTABLE_remove(&routes, addr);
+            slot = 0;
+        }
+    }
+}
+
+static EVENT_HANDLER(dvroute_timeout)
+{
+    if (data == DV_PERIODIC){
+        expire_routes();
+        CNET_start_timer(DV_TIMER, DV_PERIOD, DV_PERIODIC);
+    }
+    else {
+        trigger_timer = NULLTIMER;
+    }
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        advertise(link);
+    }
+}
+
+void DVROUTE_init(DVROUTE_SEND send)
+{
+    DVROUTE     *self;
+
+    ADDRTABLE_free(&routes);
+    ADDRTABLE_init(&routes, sizeof(DVROUTE));
+    send_update = send;
+    trigger_timer = NULLTIMER;
+
+    self = ADDRTABLE_insert(&routes, nodeinfo.address);
+    if (self != NULL){
+        self->link = 0;
+        self->distance = 0;
+    }
+    CHECK(CNET_set_handler(DV_TIMER, dvroute_timeout, 0));
+    CNET_start_timer(DV_TIMER, DV_PERIOD, DV_PERIODIC);
+    trigger();
+}
+
+void DVROUTE_receive(int link, const unsigned char *update, size_t len)
+{
+    CnetTime    now = nodeinfo.time_in_usec;
+
+    for (size_t i = 0; i + DV_ENTRY_SIZE <= len; i += DV_ENTRY_SIZE){
+        const unsigned char *e = &update[i];
+        CnetAddr    addr = (CnetAddr)(((unsigned)e[0] << 24) | ((unsigned)e[1] << 16) | ((unsigned)e[2] << 8) | e[3]);
+        int         distance = e[4] + 1;
+        DVROUTE     *r;
+
+        if (distance > DV_INFINITY){
+            distance = DV_INFINITY;
+        }
+        r = ADDRTABLE_find(&routes, addr);
+        if (r == NULL){
+            if (distance == DV_INFINITY){
+                continue;
+            }
+            r = ADDRTABLE_insert(&routes, addr);
+            if (r == NULL){
+                LOG(LOG_ERROR, "out of memory, route to %d dropped\n", addr);
+                continue;
+            }
+            r->link = link;
+            r->distance = distance;
+            r->updated = now;
+            trigger();
+        }
+        else if (r->link == link){
+            // our own next hop, believe it whether the route got longer or shorter.
+            // a route that has gone keeps the time it went, for expire_routes()
+            if (distance < DV_INFINITY || r->distance < DV_INFINITY){
+                r->updated = now;
+            }
+            if (distance != r->distance){
+                r->distance = distance;
+                trigger();
+            }
+        }
+        else if (distance < r->distance){
+            r->link = link;
+            r->distance = distance;
+            r->updated = now;
+            trigger();
+        }
+    }
+}
+
+int DVROUTE_link(CnetAddr dest)
+{
+    DVROUTE     *r = ADDRTABLE_find(&routes, dest);
+
+    return (r == NULL || r->distance == DV_INFINITY) ? -1 : r->link;
+}
+
+int DVROUTE_distance(CnetAddr dest)
+{
+    DVROUTE     *r = ADDRTABLE_find(&routes, dest);
+
+    return (r == NULL) ? DV_INFINITY : r->distance;
+}
+
+void DVROUTE_show(void)
+{
+    DVROUTE     *r;
+    CnetAddr    addr;
+    int         slot = 0;
+
+    printf("\n\tdest\tlink\thops\n");
+    while ((r = ADDRTABLE_next(&routes, &slot, &addr)) != NULL){
+        if (r->distance < DV_INFINITY){
+            printf("\t%d\t%d\t%d\n", addr, r->link, r->distance);
+        }
+        else {
+            printf("\t%d\t-\tunreachable\n", addr);
+        }
+    }
+}
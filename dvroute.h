@@ -0,0 +1,69 @@
+#ifndef _DVROUTE_H
+#define _DVROUTE_H
+
+#include <cnet.h>
+#include <stddef.h>
+
+/*  Distance-vector routing, run by every host and router.
+
+    Each node keeps the distance in hops to every address it has heard of
+    and the link that leads there, and tells its neighbours about them:
+    every DV_PERIOD usecs, and DV_TRIGGER_DELAY usecs after anything changes.
+    A route that is not refreshed for DV_TIMEOUT usecs is advertised as
+    unreachable, and forgotten DV_TIMEOUT usecs after that.
+
+    Routes are advertised back down the link they were learned on with a
+    distance of DV_INFINITY (split horizon with poisoned reverse), so two
+    neighbours never count to infinity between themselves.
+
+    The module does not know how frames are built. The protocol gives
+    DVROUTE_init() a function that sends an update on a link, in whatever
+    frame it likes, and hands updates that arrive to DVROUTE_receive().
+    An update is a list of DV_ENTRY_SIZE byte entries, a 4 byte address in
+    network byte order followed by a 1 byte distance.
+ */
+
+//  A DISTANCE MEANING UNREACHABLE, SO NO ROUTE MAY BE LONGER THAN DV_INFINITY - 1 HOPS
+#define DV_INFINITY         16
+
+//  HOW OFTEN EVERY ROUTE IS ADVERTISED, AND HOW LONG ONE LASTS WITHOUT BEING HEARD AGAIN, IN MICROSECONDS
+#ifndef DV_PERIOD
+#define DV_PERIOD           10000000
+#endif
+#ifndef DV_TIMEOUT
+#define DV_TIMEOUT          (3 * DV_PERIOD)
+#endif
+
+//  HOW LONG A TRIGGERED UPDATE WAITS FOR MORE CHANGES TO GO WITH IT, IN MICROSECONDS
+#ifndef DV_TRIGGER_DELAY
+#define DV_TRIGGER_DELAY    50000
+#endif
+
+//  THE TIMER EVENT THE MODULE USES, WHICH THE PROTOCOL MUST LEAVE ALONE
+#ifndef DV_TIMER
+#define DV_TIMER            EV_TIMER3
+#endif
+
+#define DV_ENTRY_SIZE       5
+#define DV_MAX_ENTRIES      256     // per update, a larger table is sent in several
+#define DV_MAX_UPDATE       (DV_MAX_ENTRIES * DV_ENTRY_SIZE)
+
+//  SENDS len BYTES OF UPDATE TO THE NEIGHBOUR ON link
+typedef void    (*DVROUTE_SEND)(int link, const unsigned char *update, size_t len);
+
+//  START WITH A ROUTE TO THIS NODE ONLY, AND TELL THE NEIGHBOURS ABOUT IT
+extern  void    DVROUTE_init(DVROUTE_SEND send);
+
+//  TAKE IN AN UPDATE THAT ARRIVED ON link
+extern  void    DVROUTE_receive(int link, const unsigned char *update, size_t len);
+
+//  THE LINK TO FORWARD A FRAME FOR dest ON, 0 FOR THIS NODE, -1 IF dest IS UNREACHABLE
+extern  int     DVROUTE_link(CnetAddr dest);
+
+//  THE DISTANCE TO dest IN HOPS, DV_INFINITY IF IT IS UNREACHABLE
+extern  int     DVROUTE_distance(CnetAddr dest);
+
+//  PRINT THE ROUTING TABLE
+extern  void    DVROUTE_show(void);
+
+#endif
@@ -0,0 +1,256 @@
+#include <string.h>
+
+#include "fec.h"
+
+/*  Erasure codes for forward error correction, see fec.h.
+
+    GF(2^8) is built on the polynomial x^8 + x^4 + x^3 + x^2 + 1, with
+    log and exp tables for single products and a full 256 x 256 product
+    table for gf_mul_add_sw(). Both are built on first use.
+
+    Data shard i is given the field element 128 + i and parity shard j
+    the element j, so the two sets never meet and 1 / (j ^ (128 + i)) is
+    always defined. Every square submatrix of a Cauchy matrix can be
+    inverted, and scaling column i by 128 + i keeps it that way while
+    making row 0 all ones.
+
+    gf_mul_add_hw() splits each byte into its two nibbles and looks up
+    c times each nibble in a 16-entry table with pshufb, so 16 bytes cost
+    two lookups, a shift and three logic operations.
+ */
+
+#define GF_POLY             0x11d
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GF_HAVE_HW          1
+#include <tmmintrin.h>
+#else
+#define GF_HAVE_HW          0
+#endif
+
+static  uint8_t     gf_exp[512];        // doubled so gf_exp[log a + log b] needs no modulus
+static  uint8_t     gf_log[256];
+static  uint8_t     gf_product[256][256];
+static  int         gf_ready = 0;
+
+//  THE VARIANT gf_mul_add() CALLS, CHOSEN ON FIRST USE
+static  void        (*gf_mul_add_impl)(uint8_t *, const uint8_t *, uint8_t, size_t) = NULL;
+
+
+static void gf_init(void)
+{
+    int     x = 1;
+
+    for (int i = 0; i < 255; i++){
+        gf_exp[i] = gf_exp[i + 255] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100){
+            x ^= GF_POLY;
+        }
+    }
+    gf_exp[510] = gf_exp[511] = gf_exp[0];
+    for (int a = 1; a < 256; a++){
+        for (int b = 1; b < 256; b++){
+            gf_product[a][b] = gf_exp[gf_log[a] + gf_log[b]];
+        }
+    }
+    gf_ready = 1;
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (!gf_ready){
+        gf_init();
+    }
+    return (a == 0 || b == 0) ? 0 : gf_exp[gf_log[a] + gf_log[b]];
+}
+
+//  THE INVERSE OF a, WHICH MUST NOT BE 0
+static uint8_t gf_inv(uint8_t a)
+{
+    if (!gf_ready){
+        gf_init();
+    }
+    return gf_exp[255 - gf_log[a]];
+}
+
+uint8_t fec_coef(int j, int i)
+{
+    uint8_t y = (uint8_t)(FEC_MAX_SHARDS + i);
+
+    return gf_mul(y, gf_inv((uint8_t)j ^ y));
+}
+
+void gf_mul_add_sw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+{
+    const uint8_t   *row;
+
+    if (!gf_ready){
+        gf_init();
+    }
+    row = gf_product[c];
+    for (size_t b = 0; b < n; b++){
+        dst[b] ^= row[src[b]];
+    }
+}
+
+#if GF_HAVE_HW
+__attribute__((target("ssse3")))
+void gf_mul_add_hw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+{
+    uint8_t     lo[16], hi[16];
+    __m128i     tlo, thi, mask = _mm_set1_epi8(0x0f);
+    size_t      b = 0;
+
+    for (int x = 0; x < 16; x++){
+        lo[x] = gf_mul(c, (uint8_t)x);
+        hi[x] = gf_mul(c, (uint8_t)(x << 4));
+    }
+    tlo = _mm_loadu_si128((const __m128i *)lo);
+    thi = _mm_loadu_si128((const __m128i *)hi);
+    for ( ; b + 16 <= n; b += 16){
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + b));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + b));
+        __m128i l = _mm_and_si128(s, mask);
+        __m128i h = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+
+        d = _mm_xor_si128(d, _mm_xor_si128(_mm_shuffle_epi8(tlo, l), _mm_shuffle_epi8(thi, h)));
+        _mm_storeu_si128((__m128i *)(dst + b), d);
+    }
+    if (b < n){
+        gf_mul_add_sw(dst + b, src + b, c, n - b);
+    }
+}
+
+int gf_mul_add_hw_available(void)
+{
+    return __builtin_cpu_supports("ssse3") != 0;
+}
+
+#else
+void gf_mul_add_hw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+{
+    gf_mul_add_sw(dst, src, c, n);
+}
+
+int gf_mul_add_hw_available(void)
+{
+    return 0;
+}
+#endif
+
+void gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n)
+{
+    if (c == 0){
+        return;
+    }
+    if (c == 1){
+        // plain parity, 8 bytes at a time
+        size_t  b = 0;
+
+        for ( ; b + 8 <= n; b += 8){
+            uint64_t d, s;
+
+            memcpy(&d, dst + b, 8);
+            memcpy(&s, src + b, 8);
+            d ^= s;
+            memcpy(dst + b, &d, 8);
+        }
+        for ( ; b < n; b++){
+            dst[b] ^= src[b];
+        }
+        return;
+    }
+    if (gf_mul_add_impl == NULL){
+        gf_mul_add_impl = gf_mul_add_hw_available() ? gf_mul_add_hw : gf_mul_add_sw;
+    }
+    gf_mul_add_impl(dst, src, c, n);
+}
+
+void fec_encode(int m, int i, const void *data, size_t len, uint8_t *const parity[])
+{
+    for (int j = 0; j < m; j++){
+        gf_mul_add(parity[j], data, fec_coef(j, i), len);
+    }
+}
+
+int fec_decode(int k, int m, const void *const data[], const size_t len[],
+               uint8_t *const parity[], uint8_t *const out[], size_t n)
+{
+    int         lost[FEC_MAX_SHARDS], used[FEC_MAX_SHARDS];
+    uint8_t     a[FEC_MAX_SHARDS][FEC_MAX_SHARDS], inv[FEC_MAX_SHARDS][FEC_MAX_SHARDS];
+    int         e = 0, p = 0;
+
+    for (int i = 0; i < k; i++){
+        if (data[i] == NULL){
+            lost[e++] = i;
+        }
+    }
+    if (e == 0){
+        return 0;
+    }
+    for (int j = 0; j < m && p < e; j++){
+        if (parity[j] != NULL){
+            used[p++] = j;
+        }
+    }
+    if (p < e){
+        return -1;
+    }
+
+    // take the shards that arrived out of each parity shard used, leaving what the lost ones sum to
+    for (int r = 0; r < e; r++){
+        for (int i = 0; i < k; i++){
+            if (data[i] != NULL){
+                gf_mul_add(parity[used[r]], data[i], fec_coef(used[r], i), len[i]);
+            }
+        }
+        for (int c = 0; c < e; c++){
+            a[r][c] = fec_coef(used[r], lost[c]);
+            inv[r][c] = (r == c);
+        }
+    }
+
+    // Gauss-Jordan elimination, which cannot find a zero column in a Cauchy matrix
+    for (int c = 0; c < e; c++){
+        int     pivot = c;
+        uint8_t scale;
+
+        while (a[pivot][c] == 0){
+            pivot++;
+        }
+        if (pivot != c){
+            for (int x = 0; x < e; x++){
+                uint8_t t;
+
+                t = a[c][x];    a[c][x] = a[pivot][x];      a[pivot][x] = t;
+                t = inv[c][x];  inv[c][x] = inv[pivot][x];  inv[pivot][x] = t;
+            }
+        }
+        scale = gf_inv(a[c][c]);
+        for (int x = 0; x < e; x++){
+            a[c][x] = gf_mul(a[c][x], scale);
+            inv[c][x] = gf_mul(inv[c][x], scale);
+        }
+        for (int r = 0; r < e; r++){
+            uint8_t f = a[r][c];
+
+            if (r == c || f == 0){
+                continue;
+            }
+            for (int x = 0; x < e; x++){
+                a[r][x] ^= gf_mul(f, a[c][x]);
+                inv[r][x] ^= gf_mul(f, inv[c][x]);
+            }
+        }
+    }
+
+    for (int c = 0; c < e; c++){
+        memset(out[lost[c]], 0, n);
+        for (int r = 0; r < e; r++){
+            gf_mul_add(out[lost[c]], parity[used[r]], inv[c][r], n);
+        }
+    }
+    return e;
+}
@@ -0,0 +1,53 @@
+#ifndef _FEC_H
+#define _FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*  Erasure codes for forward error correction.
+
+    A block is k data shards followed by m parity shards, and any k of
+    the k + m that arrive are enough to rebuild the data shards that did
+    not. Parity shard j is the sum, in GF(2^8), of every data shard i
+    times fec_coef(j, i). The coefficients come from a Cauchy matrix whose
+    columns are scaled so that parity shard 0 is the plain XOR of the data
+    shards, so with m = 1 this is a simple parity code, and with m > 1 it
+    is a Reed-Solomon code.
+
+    The work is all in gf_mul_add(), which multiplies a shard by a
+    constant and adds it to another. It uses the SSSE3 pshufb instruction,
+    16 bytes at a time, when the CPU has it, and one table lookup per byte
+    otherwise.
+
+    A shard may be shorter than the others in its block. It is treated
+    as if it were padded with zeros.
+ */
+
+//  THE MOST DATA SHARDS, AND THE MOST PARITY SHARDS, IN A BLOCK
+#define FEC_MAX_SHARDS      128
+
+//  THE COEFFICIENT OF DATA SHARD i IN PARITY SHARD j
+extern  uint8_t     fec_coef(int j, int i);
+
+//  ADD DATA SHARD i, len BYTES AT data, INTO THE m PARITY SHARDS BEING BUILT FOR ITS BLOCK
+extern  void        fec_encode(int m, int i, const void *data, size_t len, uint8_t *const parity[]);
+
+//  REBUILD THE LOST DATA SHARDS OF A BLOCK OF k DATA AND m PARITY SHARDS OF UP TO n BYTES.
+//  data[i] HOLDS len[i] BYTES OF DATA SHARD i, OR IS NULL IF THE SHARD WAS LOST, WHEN ITS n
+//  BYTES ARE WRITTEN TO out[i]. parity[j] HOLDS THE n BYTES OF PARITY SHARD j, OR IS NULL IF
+//  IT WAS LOST. THE PARITY SHARDS THAT ARE USED ARE OVERWRITTEN. RETURN THE NUMBER OF SHARDS
+//  REBUILT, OR -1 IF MORE DATA SHARDS WERE LOST THAN PARITY SHARDS ARRIVED
+extern  int         fec_decode(int k, int m, const void *const data[], const size_t len[],
+                        uint8_t *const parity[], uint8_t *const out[], size_t n);
+
+//  dst += c * src, IN GF(2^8), OVER n BYTES, USING THE FASTEST VARIANT THIS CPU SUPPORTS
+extern  void        gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n);
+
+//  THE PORTABLE VARIANT
+extern  void        gf_mul_add_sw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n);
+
+//  THE SSSE3 VARIANT, ONLY TO BE CALLED IF gf_mul_add_hw_available() RETURNS 1
+extern  void        gf_mul_add_hw(uint8_t *dst, const uint8_t *src, uint8_t c, size_t n);
+extern  int         gf_mul_add_hw_available(void);
+
+#endif
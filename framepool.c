@@ -0,0 +1,123 @@
+#include <cnet.h>
+#include <stdlib.h>
+
+#include "framepool.h"
+#include "trace.h"
+
+/*  A pool of reference-counted frame buffers, see framepool.h.
+
+    Each buffer is preceded by a small header holding its reference count
+    and, while it is free, the next buffer on the free list. Headers and
+    buffers are rounded up to POOL_ALIGN bytes so that a buffer can hold
+    any struct.
+ */
+
+#define POOL_ALIGN          16
+#define ROUNDUP(n)          (((n) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+typedef struct _POOLHDR {
+    struct _POOLHDR *next;  // the next free buffer, while this one is free
+    int             refs;   // 0 while free
+} POOLHDR;
+
+typedef struct _SLAB {
+    struct _SLAB    *next;
+} SLAB;
+
+#define HDR_SIZE            ROUNDUP(sizeof(POOLHDR))
+#define SLAB_HDR_SIZE       ROUNDUP(sizeof(SLAB))
+
+#define HDR(buf)            ((POOLHDR *)((unsigned char *)(buf) - HDR_SIZE))
+#define BUF(hdr)            ((void *)((unsigned char *)(hdr) + HDR_SIZE))
+
+static  size_t      stride      = 0;        // HDR_SIZE plus the rounded buffer size
+static  POOLHDR     *freelist   = NULL;
+static  SLAB        *slabs      = NULL;
+static  long        nslabs      = 0;
+static  long        inuse       = 0;
+static  long        peak        = 0;
+
+
+void FRAMEPOOL_init(size_t bufsize)
+{
+    while (slabs != NULL){
+        SLAB *s = slabs;
+
+        slabs = s->next;
+        free(s);
+    }
+    stride = HDR_SIZE + ROUNDUP(bufsize);
+    freelist = NULL;
+    nslabs = 0;
+    inuse = 0;
+    peak = 0;
+}
+
+void *FRAMEPOOL_alloc(void)
+{
+    POOLHDR     *h;
+
+    if (freelist == NULL){
+        SLAB            *s = malloc(SLAB_HDR_SIZE + FRAMEPOOL_SLAB * stride);
+        unsigned char   *p;
+
+        if (s == NULL || stride == 0){
+            free(s);
+            return NULL;
+        }
+        s->next = slabs;
+        slabs = s;
+        nslabs++;
+        p = (unsigned char *)s + SLAB_HDR_SIZE;
+        for (int i = FRAMEPOOL_SLAB - 1; i >= 0; i--){
+            h = (POOLHDR *)(p + i * stride);
+            h->refs = 0;
+            h->next = freelist;
+            freelist = h;
+        }
+    }
+    h = freelist;
+    freelist = h->next;
+    h->next = NULL;
+    h->refs = 1;
+    if (++inuse > peak){
+        peak = inuse;
+    }
+    return BUF(h);
+}
+
+void *FRAMEPOOL_hold(void *buf)
+{
+    HDR(buf)->refs++;
+    return buf;
+}
+
+void FRAMEPOOL_release(void *buf)
+{
+    POOLHDR     *h;
+
+    if (buf == NULL){
+        return;
+    }
+    h = HDR(buf);
+    if (h->refs <= 0){
+        LOG(LOG_ERROR, "frame buffer released more often than it was held\n");
+        return;
+    }
+    if (--h->refs == 0){
+        h->next = freelist;
+        freelist = h;
+        inuse--;
+    }
+}
+
+int FRAMEPOOL_refs(const void *buf)
+{
+    return HDR(buf)->refs;
+}
+
+void FRAMEPOOL_show(void)
+{
+    printf("Frame buffers:  %ld in use, %ld at most, %ld allocated of %lu bytes each\n",
+        inuse, peak, nslabs * FRAMEPOOL_SLAB, (unsigned long)(stride - HDR_SIZE));
+}
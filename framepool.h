@@ -0,0 +1,44 @@
+#ifndef _FRAMEPOOL_H
+#define _FRAMEPOOL_H
+
+#include <stddef.h>
+
+/*  A pool of frame buffers, so that a frame is built once and then shared
+    by everything that needs it rather than copied from one to the next.
+
+    Every buffer is the same size, given to FRAMEPOOL_init(). Buffers are
+    carved out of slabs of FRAMEPOOL_SLAB at a time, and a buffer that is
+    released goes back on a free list rather than to malloc(), so after
+    the first few frames taking a buffer costs a few instructions.
+
+    Each buffer counts its references. FRAMEPOOL_alloc() gives a buffer
+    with one, FRAMEPOOL_hold() adds one and FRAMEPOOL_release() takes one
+    away. The buffer returns to the pool when the last one goes. A frame
+    waiting in a send window and in a link's queue at the same time is one
+    buffer with two references.
+ */
+
+//  THE NUMBER OF BUFFERS ALLOCATED TOGETHER WHEN THE POOL RUNS DRY
+#ifndef FRAMEPOOL_SLAB
+#define FRAMEPOOL_SLAB      16
+#endif
+
+//  EMPTY THE POOL AND MAKE ITS BUFFERS bufsize BYTES LONG. EVERY BUFFER TAKEN BEFORE IS LOST
+extern  void    FRAMEPOOL_init(size_t bufsize);
+
+//  A BUFFER WITH ONE REFERENCE, OR NULL IF OUT OF MEMORY
+extern  void    *FRAMEPOOL_alloc(void);
+
+//  ADD A REFERENCE TO A BUFFER, RETURN THE BUFFER
+extern  void    *FRAMEPOOL_hold(void *buf);
+
+//  DROP A REFERENCE TO A BUFFER, RETURNING IT TO THE POOL WITH THE LAST. NULL IS IGNORED
+extern  void    FRAMEPOOL_release(void *buf);
+
+//  THE NUMBER OF REFERENCES TO A BUFFER
+extern  int     FRAMEPOOL_refs(const void *buf);
+
+//  PRINT HOW MANY BUFFERS ARE IN USE
+extern  void    FRAMEPOOL_show(void);
+
+#endif
@@ -2,16 +2,204 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*  This is an implementation of a stop-and-wait data link protocol.
+#include "addrtable.h"
+#include "checksum.h"
+#include "compress.h"
+#include "fec.h"
+#include "framepool.h"
+#include "linkqueue.h"
+#include "metrics.h"
+#include "trace.h"
+
+/*  This is an implementation of a sliding window data link protocol.
 
     This protocol provides a reliable data-link layer for a 2-node network.
-    This protocol employs only data and acknowledgement frames -
-    piggybacking and negative acknowledgements are not used.
+    This protocol employs data, acknowledgement and negative acknowledgement
+    frames. Acknowledgements are cumulative, each one covering every frame
+    received in order. An acknowledgement is held back for up to ACK_DELAY
+    usecs, or until ACK_EVERY frames are waiting for it, so that it can
+    ride in the header of a data frame going the other way or cover
+    several frames at once. It is only sent in a frame of its own if
+    neither happens first. A frame that arrives out of order, or again, is
+    acknowledged at once, as the sender may be missing a frame or an ack.
+
+    The sender may have up to WINDOW_SIZE frames outstanding, and when the
+    timer of the oldest frame expires every outstanding frame is sent again
+    (Go-Back-N). A WINDOW_SIZE of 1 gives the original stop-and-wait
+    behaviour.
+
+    With -DARQ_MODE=ARQ_SELECTIVE_REPEAT every frame has its own timer, the
+    receiver buffers frames that arrive out of order, acknowledging each
+    one alone in an ack frame as well as the cumulative ack, and only the
+    frames that were lost are sent again.
+
+    A receiver that finds a bad checksum or a gap in the sequence numbers
+    sends a NAK for the frame it is waiting for, and the sender resends it
+    at once instead of waiting for its timer. Build with -DUSE_NAKS=0 to
+    rely on timeouts alone.
+
+    Each destination has a connection of its own, with its own window,
+    sequence numbers and timers, opened the first time a message is sent
+    to it. When one connection's window fills, only messages for that host
+    are held back by the application layer.
+
+    A message longer than FRAG_SIZE is cut into fragments, each sent in a
+    frame with a sequence number, timer and ack of its own, so a damaged
+    fragment is all that has to be sent again. The receiver gathers the
+    fragments, which reach it in order, and passes the message up once
+    the last one is in. With -DFRAG_SIZE=FRAG_ADAPTIVE each connection
+    finds its own fragment size, doubling or halving it for as long as
+    that lowers the bytes sent for each byte acknowledged.
+
+    The round trip time and the loss of the path to each host are measured
+    separately for each of our links. With -DMULTIPATH=1 the data frames to
+    a host are striped across every link, both ways round a ring, each
+    frame going on the path where it should arrive first: the one with the
+    least queued ahead of it and the shortest measured trip, allowing for
+    the frames that path loses. The frames reach the receiver out of order,
+    so striping needs selective repeat, which becomes the default, and a
+    frame arriving early is buffered rather than NAKed.
+
+    A frame that times out is sent again on the best path there is now.
+    After PATH_DOWN_TIMEOUTS timeouts in a row, a path is taken to be down:
+    the frames waiting on it move to another path at once, and until an
+    ack comes back along it, the oldest frame in the window is sent down it
+    every PROBE_INTERVAL usecs to see if it has recovered.
 
-    It is based on Tanenbaum's 'protocol 4', 2nd edition, p227.
+    With -DFEC_M=m each block of FEC_K data frames is followed by m parity
+    frames, built from the block's payloads by fec.c as each frame is first
+    sent. The receiver keeps the frames of the latest block, and once any
+    FEC_K of them are in, it rebuilds the data frames that were lost and
+    carries on as if they had arrived, without waiting for a timeout or a
+    round trip. A gap that the last data frame of a block shows is left
+    for the parity frames, which come next, unless the block has lost more
+    frames than they can rebuild. Any other gap is NAKed as before, as the
+    rest of a block may be slow to come.
+
+    Each message is compressed by compress.c before it is cut into
+    fragments, unless that would not save enough, when it goes as it is.
+    Every fragment says how its message was carried, and the receiver
+    puts the message back together before decompressing it.
+
+    Every frame lives in a buffer from the frame pool. A message is read
+    from the application straight into the frame that carries it, and that
+    one buffer is held by the window, by any link queue it waits in, and
+    by every retransmission, so the payload is never copied by the
+    protocol. Frames that arrive are read into a buffer too, which is
+    forwarded or, with selective repeat, held until it can be delivered.
+
+    It is based on Tanenbaum's 'protocol 4', 2nd edition, p227, and on his
+    'protocol 5' and 'protocol 6' for the sliding window.
  */
 
-//  A FRAME CAN BE EITHER DATA OR AN ACKNOWLEDGMENT FRAME
+//  1 TO STRIPE THE DATA FRAMES TO A HOST ACROSS ALL OUR LINKS, 0 TO SEND THEM ON THE SHORTEST PATH
+#ifndef MULTIPATH
+#define MULTIPATH           0
+#endif
+
+//  THE TWO WAYS OF RECOVERING FROM A LOST FRAME
+#define ARQ_GO_BACK_N           0
+#define ARQ_SELECTIVE_REPEAT    1
+
+#ifndef ARQ_MODE
+#if MULTIPATH
+#define ARQ_MODE            ARQ_SELECTIVE_REPEAT
+#else
+#define ARQ_MODE            ARQ_GO_BACK_N
+#endif
+#endif
+
+#if MULTIPATH && ARQ_MODE != ARQ_SELECTIVE_REPEAT
+#error MULTIPATH delivers frames out of order, it needs ARQ_MODE=ARQ_SELECTIVE_REPEAT
+#endif
+
+//  1 TO ASK FOR A DAMAGED OR MISSING FRAME WITH A NAK, 0 TO WAIT FOR THE SENDER'S TIMER
+#ifndef USE_NAKS
+#define USE_NAKS            1
+#endif
+
+//  HOW LONG AN ACK WAITS FOR A DATA FRAME TO PIGGYBACK ON, IN MICROSECONDS, 0 TO SEND IT AT ONCE
+#ifndef ACK_DELAY
+#define ACK_DELAY           2000000
+#endif
+
+//  THE FRAMES RECEIVED IN ORDER THAT AN ACK CAN WAIT TO COVER, 1 TO ACK EACH ONE WITHIN ACK_DELAY
+#ifndef ACK_EVERY
+#define ACK_EVERY           2
+#endif
+
+//  1 FOR EVERY HOST TO GENERATE MESSAGES, 0 FOR ONLY THE FIRST, AS THE ORIGINAL LAB DID. ONLY WITH 1
+//  IS THERE DATA GOING BACK FOR ACKS TO PIGGYBACK ON
+#ifndef ALL_SENDERS
+#define ALL_SENDERS         0
+#endif
+
+//  THE NUMBER OF FRAMES THE SENDER MAY HAVE OUTSTANDING, e.g. -DWINDOW_SIZE=16.
+//  STRIPING HAS TWO PATHS OR MORE TO KEEP FULL, SO IT STARTS WITH TWICE AS MANY
+#ifndef WINDOW_SIZE
+#if MULTIPATH
+#define WINDOW_SIZE         16
+#else
+#define WINDOW_SIZE         8
+#endif
+#endif
+
+//  THE LARGEST PAYLOAD OF A DATA FRAME, LONGER MESSAGES ARE SENT IN FRAGMENTS, e.g. -DFRAG_SIZE=4096.
+//  FRAG_ADAPTIVE LETS EACH CONNECTION FIND ITS OWN, BETWEEN FRAG_MIN AND MAX_MESSAGE_SIZE
+#define FRAG_ADAPTIVE       0
+
+#ifndef FRAG_SIZE
+#define FRAG_SIZE           MAX_MESSAGE_SIZE
+#endif
+
+#define FRAG_MIN            256
+
+//  FRAG_ADAPTIVE: THE NUMBER OF FRAMES ACKNOWLEDGED BETWEEN CHANGES TO THE FRAGMENT SIZE
+#define FRAG_EPOCH          (4 * WINDOW_SIZE)
+
+//  SEQUENCE NUMBERS RUN FROM 0 TO MAX_SEQ, A MULTIPLE OF THE WINDOW SIZE
+#define MAX_SEQ             (16 * WINDOW_SIZE - 1)
+
+//  LIMITS ON THE RETRANSMISSION TIMEOUT, IN MICROSECONDS, AND ON ITS DOUBLING
+#define RTO_MIN             200000
+#define RTO_MAX             120000000
+#define MAX_BACKOFF         6
+
+//  A PATH'S LOSS IS A MOVING AVERAGE OF ITS TIMEOUTS WITH WEIGHT 1/LOSS_WEIGHT, CAPPED AT LOSS_MAX
+#define LOSS_WEIGHT         8
+#define LOSS_MAX            0.9
+
+//  THE TIMEOUTS IN A ROW THAT TAKE A PATH DOWN, AND HOW OFTEN A PATH THAT IS DOWN IS PROBED, IN USECS
+#ifndef PATH_DOWN_TIMEOUTS
+#define PATH_DOWN_TIMEOUTS  3
+#endif
+
+#ifndef PROBE_INTERVAL
+#define PROBE_INTERVAL      10000000
+#endif
+
+//  THE PARITY FRAMES SENT AFTER EACH BLOCK OF FEC_K DATA FRAMES, 0 FOR NO FORWARD ERROR CORRECTION.
+//  ANY FEC_M FRAMES OF A BLOCK CAN BE LOST AND STILL BE REBUILT, e.g. -DFEC_M=1 -DFEC_K=8
+#ifndef FEC_M
+#define FEC_M               0
+#endif
+
+#ifndef FEC_K
+#define FEC_K               4
+#endif
+
+//  THE PARITY FRAMES KEPT FOR A BLOCK, AT LEAST ONE SO THE ARRAYS ARE NEVER EMPTY
+#define FEC_PARITY          (FEC_M > 0 ? FEC_M : 1)
+
+//  THE BLOCKS A RECEIVER GATHERS AT ONCE, SO STRIPED FRAMES OF ONE BLOCK CAN OVERTAKE THE LAST'S PARITY
+#define FEC_BLOCKS          2
+
+#if FEC_M > 0 && ((MAX_SEQ + 1) % FEC_K != 0 || FEC_K > WINDOW_SIZE || FEC_M > FEC_MAX_SHARDS)
+#error FEC_K must divide the sequence numbers evenly and fit in the window, and FEC_M be at most FEC_MAX_SHARDS
+#endif
+
+//  A FRAME CAN BE EITHER DATA, AN ACKNOWLEDGMENT, A NEGATIVE ACKNOWLEDGMENT OR A PARITY FRAME
+typedef enum { DL_DATA, DL_ACK, DL_NAK, DL_PARITY } FRAMEKIND;
 
 //  DATA FRAMES CARRY A MAXIMUM-SIZED PAYLOAD, OUR MESSAGE
 typedef struct {
@@ -23,10 +211,14 @@ typedef struct {
 typedef struct {
     //  THE FIRST FIELDS IN THE STRUCTURE DEFINE THE FRAME HEADER
     CnetAddr    src,dest; 	// source and destination node addresses
+    FRAMEKIND   kind;       // DL_DATA, DL_ACK, DL_NAK or DL_PARITY
     size_t	    len;       	// the length of the msg field only
-    int         checksum;  	// checksum of the whole frame
-    int         seq;        // seq > 0 for valid data, else = -1
-    int         ack;        // ack > 0 for valid ack, else = -1    
+    uint16_t    hdrsum;     // internet checksum of the header, patched by routers as hop_count changes
+    uint16_t    codec;      // how the message a data frame is part of was compressed, CODEC_STORE if it was not
+    int         datasum;    // checksum() of the msg field, only checked by the destination
+    int         seq;        // seq > 0 for valid data, else = -1; for a NAK, the frame to send again; for an ack, one that arrived out of order; for parity, the first frame of the block
+    int         ack;        // ack > 0 for valid ack, else = -1 (the last frame received in order), data frames may carry one too; for parity, that of the block's len and more
+    int         more;       // 1 if the next data frame carries more of the same message; for parity, which parity frame of the block it is
 
     // fields for the shortest path
     int         hop_count;  // an int value to store the hop count (how many nodes the message has passed through)
@@ -34,38 +226,96 @@ typedef struct {
     MSG          msg;
 } FRAME;
 
-//  a SWCONN struct to hold the connection state
+//  a SWCONN struct to hold the state of the connection to one host, kept in the connections table
 typedef struct {
     CnetAddr    src,dest; 	// source and destination connection addresses
-    CnetTimerID lasttimer;
-    FRAME       lastframe;
-    int         ackexpected, frameexpected, nextframetosend;
-    // table for finding the shortest path
-    int         found_shortest_path[14];  // 1 if the shortest path has been found, 0 otherwise
-    CnetAddr    host_list[14];  // an array to store the list of nodes that the message has passed through
-    int         host_hop_count[14];  // an array to store the hop count of each node that the message has passed through
-    MSG         last_receive_msg;  // the last message received
+    CnetTimerID lasttimer;  // go-back-n: the timer of the oldest outstanding frame
+    FRAME       *window[WINDOW_SIZE];  // the frames sent but not yet acknowledged, indexed by seq % WINDOW_SIZE
+    CnetTimerID timers[WINDOW_SIZE];  // selective repeat: the timer of each frame in the window
+    int         acked[WINDOW_SIZE];  // selective repeat: 1 if the frame has been acknowledged
+    CnetTime    sendtime[WINDOW_SIZE];  // when each frame in the window was first sent
+    int         retransmitted[WINDOW_SIZE];  // 1 if the frame has been sent more than once
+    int         sentlink[WINDOW_SIZE];  // the link the frame last went out on, 0 if it went out on every link
+    int         nbuffered;  // the number of frames in the window
+    int         ackexpected, nextframetosend;
+    int         blocked;  // 1 if the application may not send to dest until the window has room
+    // the message being cut into fragments as the window makes room for them
+    FRAME       *pending;  // the whole message, NULL if there is none
+    size_t      pendinglen;  // its length
+    size_t      pendingoff;  // how much of it has gone into the window
+    CODEC       pendingcodec;  // how it was compressed
+    // FRAG_ADAPTIVE: the fragment size, and how well it has been doing
+    size_t      fragsize;
+    int         fragstep;  // 1 if the fragment size was last doubled, -1 if it was halved
+    int         epochframes;  // frames acknowledged since the fragment size last changed
+    long        epochpayload;  // the payload bytes they carried
+    long        epochwire;  // the bytes sent in that time, every copy and retransmission
+    double      efficiency;  // epochpayload / epochwire in the last epoch, 0 before the first
+    // FEC_M: the parity frames of the block being sent, added to as each of its data frames first goes out
+    FRAME       *parity[FEC_PARITY];  // NULL if there were no buffers for them
+    uint8_t     paritymeta[FEC_PARITY][4];  // the parity of the len and more of the block's frames
+    size_t      paritylen;  // the longest payload in the block so far
 } SWCONN;
 
+//  a ROUTE struct to hold the shortest path found to a host, kept in the routes table
+typedef struct {
+    int         link;  // the link to send on, 0 until a path has been found
+    int         hops;  // the hop count of the ack that taught us the path
+} ROUTE;
+
+//  a PATH struct to hold what we have measured of the way to a host out of one of our links
+typedef struct {
+    // round trip time (Jacobson/Karels), not counting the time to serialize the frame itself
+    CnetTime    srtt;  // smoothed round trip time, 0 until the first sample
+    CnetTime    rttvar;  // smoothed mean deviation of the round trip time
+    int         backoff;  // timeouts since the last sample, each one doubles the timeout
+    int         hops;  // the number of links a data frame crosses to reach the host this way, 1 until an ack is measured
+    double      loss;  // the share of frames sent this way that time out, a moving average
+    int         timeouts;  // timeouts in a row, since an ack last came back this way
+    int         down;  // 1 once PATH_DOWN_TIMEOUTS timeouts in a row have gone unanswered
+} PATH;
+
+//  a PEER struct to hold what we know of one other host as a receiver, and the paths to it
+typedef struct {
+    CnetAddr    addr;  // the address of the other host
+    int         frameexpected;  // the next sequence number expected from that host
+    int         nak_sent;  // 1 if we have already told that host frameexpected is missing, with a NAK or an ack
+    // an ack we owe that host, waiting for a data frame to piggyback on
+    int         ackpending;  // 1 if ackno has not been sent yet
+    int         ackno;  // the ack to send, the last frame received in order
+    int         ackcount;  // the frames received in order that it covers
+    int         acklink;  // the link to send it on if it goes on its own
+    int         ackhops;  // the hop count of the data frame being acknowledged
+    CnetTimerID acktimer;  // fires after ACK_DELAY to send the ack on its own
+    PATH        *path;  // the path out of each of our links, path[0] unused
+    CnetTimerID probetimer;  // fires every PROBE_INTERVAL while a path to that host is down
+    // selective repeat: frames from that host that arrived ahead of frameexpected
+    FRAME       *inbuf[WINDOW_SIZE];  // the frame with seq % WINDOW_SIZE, or NULL
+    // the fragments of a message from that host that have arrived so far
+    FRAME       *reasm;  // the first fragment, with the others copied in after it, or NULL
+    size_t      reasmlen;  // the bytes of the message in reasm
+    int         reasmlost;  // 1 if the rest of the message is to be thrown away
+    // FEC_M: the frames of the latest blocks from that host, to rebuild the ones that are lost,
+    // each block in fecblock[(seq / FEC_K) % FEC_BLOCKS]
+    int         fecblock[FEC_BLOCKS];  // the sequence number of the block's first frame, -1 for none
+    FRAME       *fecdata[FEC_BLOCKS][FEC_K];  // each data frame of the block that has arrived or been rebuilt, or NULL
+    FRAME       *fecparity[FEC_BLOCKS][FEC_PARITY];  // each parity frame of the block that has arrived, or NULL
+} PEER;
+
 
 
 //  SOME HELPFUL MACROS FOR COMMON CALCULATIONS
 #define FRAME_HEADER_SIZE	(sizeof(FRAME) - sizeof(MSG))
 #define FRAME_SIZE(frame)	(FRAME_HEADER_SIZE + frame.len)
-#define increment(seq)		seq = 1-seq
+#define increment(seq)		seq = (seq + 1) % (MAX_SEQ + 1)
+#define TRACE_KIND(f)       ((f)->kind == DL_DATA ? TK_DATA : ((f)->kind == DL_ACK ? TK_ACK : ((f)->kind == DL_NAK ? TK_NAK : TK_PARITY)))
+#define TRACE_FRAME(ev, f, link, len)   TRACE((ev), TRACE_KIND(f), (f)->src, (f)->dest, (f)->seq, (f)->ack, (link), (len))
 
 
 //  STATE VARIABLES HOLDING INFORMATION ABOUT THE LAST MESSAGE
-SWCONN      swconn; // only one connection in this part
-
-MSG       	lastmsg;
-size_t		lastmsglength		= 0;
-CnetTimerID	lasttimer		= NULLTIMER;
-
-//  STATE VARIABLES HOLDING SEQUENCE NUMBERS
-int		nextdatatosend		= 0;
-int       	ackexpected		= 0;
-int		dataexpected		= 0;
+ADDRTABLE   connections; // a pointer to the SWCONN to each host we send to, opened on the first message
+ADDRTABLE   routes; // the ROUTE to each host we have heard an ack from
+ADDRTABLE   peers;  // a pointer to the PEER of each host we exchange frames with
 
 
 //  A Function to print a frame
@@ -74,225 +324,1479 @@ void FRAME_print (FRAME *f) {
      	    f->src, f->dest, f->seq, f->ack, f->len);
 }
 
+//  PRINT A FRAME AND WHAT HAPPENED TO IT, ONLY IF EVERY FRAME IS LOGGED
+#define FRAME_log(what, f)  do { if (LOG_LEVEL >= LOG_FRAME){ printf("%s:  ", (what)); FRAME_print(f); } } while (0)
+
 //  A function to init the connection state
-void SWCONN_init(){
-    swconn.src = nodeinfo.address;
-    swconn.dest = -1;
-    swconn.lasttimer = NULLTIMER;
-    swconn.ackexpected = 0;
-    swconn.frameexpected = 0;
-    swconn.nextframetosend = 0;
+void SWCONN_init(SWCONN *conn, CnetAddr dest){
+    conn->src = nodeinfo.address;
+    conn->dest = dest;
+    conn->lasttimer = NULLTIMER;
+    conn->nbuffered = 0;
+    conn->ackexpected = 0;
+    conn->nextframetosend = 0;
+    conn->blocked = 0;
+    conn->pending = NULL;
+    conn->fragsize = MAX_MESSAGE_SIZE;
+    conn->fragstep = -1;
+    conn->epochframes = 0;
+    conn->epochpayload = 0;
+    conn->epochwire = 0;
+    conn->efficiency = 0.0;
+    for (int i = 0; i < WINDOW_SIZE; i++){
+        conn->window[i] = NULL;
+    }
+    for (int j = 0; j < FEC_PARITY; j++){
+        conn->parity[j] = NULL;
+    }
+    conn->paritylen = 0;
+}
+
+//  FIND THE CONNECTION TO A HOST, OR NULL IF WE HAVE NEVER SENT IT ANYTHING
+SWCONN *SWCONN_lookup(CnetAddr dest){
+    SWCONN **conn = ADDRTABLE_find(&connections, dest);
+
+    return (conn == NULL) ? NULL : *conn;
+}
+
+//  FIND THE CONNECTION TO A HOST, OPENING IT FOR THE FIRST MESSAGE
+SWCONN *SWCONN_find(CnetAddr dest){
+    SWCONN *conn = SWCONN_lookup(dest);
+    SWCONN **slot;
+
+    if (conn != NULL){
+        return conn;
+    }
+    // each SWCONN has its own allocation, so it stays put when the table grows
+    conn = malloc(sizeof(SWCONN));
+    if (conn == NULL){
+        return NULL;
+    }
+    slot = ADDRTABLE_insert(&connections, dest);
+    if (slot == NULL){
+        free(conn);
+        return NULL;
+    }
+    *slot = conn;
+    SWCONN_init(conn, dest);
+    return conn;
+}
+
+//  FIND THE SEQUENCE NUMBERS FOR A HOST, OR NULL IF WE HAVE NEVER HEARD OF IT
+PEER *PEER_lookup(CnetAddr addr){
+    PEER **peer = ADDRTABLE_find(&peers, addr);
+
+    return (peer == NULL) ? NULL : *peer;
+}
 
-    strcpy(swconn.last_receive_msg.data, "Initialise");
+//  FIND THE SEQUENCE NUMBERS FOR A HOST, ADDING IT ON FIRST CONTACT
+PEER *PEER_find(CnetAddr addr){
+    PEER *peer = PEER_lookup(addr);
+    PEER **slot;
 
-    for (int i = 0; i < 14; i++){
-        swconn.host_list[i] = -1;
-        swconn.host_hop_count[i] = -1;
-        swconn.found_shortest_path[i] = -1;
+    if (peer != NULL){
+        return peer;
+    }
+    // each PEER has its own allocation, so it stays put when the table grows
+    peer = malloc(sizeof(PEER));
+    if (peer == NULL){
+        return NULL;
+    }
+    peer->path = calloc(nodeinfo.nlinks + 1, sizeof(PATH));
+    slot = (peer->path == NULL) ? NULL : ADDRTABLE_insert(&peers, addr);
+    if (slot == NULL){
+        free(peer->path);
+        free(peer);
+        return NULL;
+    }
+    *slot = peer;
+    peer->addr = addr;
+    peer->frameexpected = 0;
+    peer->nak_sent = 0;
+    peer->ackpending = 0;
+    peer->ackcount = 0;
+    peer->acktimer = NULLTIMER;
+    peer->probetimer = NULLTIMER;
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        peer->path[link].hops = 1;
+    }
+    for (int i = 0; i < WINDOW_SIZE; i++){
+        peer->inbuf[i] = NULL;
+    }
+    peer->reasm = NULL;
+    peer->reasmlen = 0;
+    peer->reasmlost = 0;
+    for (int b = 0; b < FEC_BLOCKS; b++){
+        peer->fecblock[b] = -1;
+        for (int i = 0; i < FEC_K; i++){
+            peer->fecdata[b][i] = NULL;
+        }
+        for (int j = 0; j < FEC_PARITY; j++){
+            peer->fecparity[b][j] = NULL;
+        }
     }
+    return peer;
 }
-//  A FUNCTION TO TRANSMIT EITHER A DATA OR AN ACKNOWLEDGMENT FRAME
-void transmit_frame(CnetAddr srcaddr, CnetAddr destaddr, MSG *msg, size_t length, int seqno, int ackno, int link, int hop_count)
+
+//  RETURN 1 IF a <= b < c CIRCULARLY
+int between(int a, int b, int c){
+    return ((a <= b) && (b < c)) || ((c < a) && (a <= b)) || ((b < c) && (c < a));
+}
+//  RETURN THE ACK WE OWE A HOST SO A DATA FRAME CAN CARRY IT, OR -1 IF WE OWE NONE
+int take_ack(CnetAddr addr)
 {
-    FRAME       frame;
+    PEER    *peer = PEER_lookup(addr);
 
+    if (peer == NULL || peer->ackpending == 0){
+        return -1;
+    }
+    peer->ackpending = 0;
+    peer->ackcount = 0;
+    CNET_stop_timer(peer->acktimer);
+    peer->acktimer = NULLTIMER;
+    return peer->ackno;
+}
+
+//  WRITE A FRAME TO THE PHYSICAL LAYER, WITH ITS HEADER CHECKSUM RECOMPUTED FOR ANY CHANGE TO
+//  THE HEADER. THE LINK QUEUE HOLDS ITS OWN REFERENCE TO THE BUFFER IF THE FRAME HAS TO WAIT.
+//  ev IS TR_SEND OR TR_RESEND, FOR THE TRACE
+void write_frame(FRAME *f, int link, TRACEEVENT ev)
+{
+    f->hdrsum	= 0;
+    f->hdrsum	= inet_checksum(f, FRAME_HEADER_SIZE);
+    TRACE_FRAME(ev, f, link, FRAME_SIZE((*f)));
+    METRICS_count(M_SENT);
+    METRICS_tx(link, FRAME_SIZE((*f)));
+    LINKQUEUE_write(link, f, FRAME_SIZE((*f)));
+}
+
+//  A FUNCTION TO TRANSMIT AN ACKNOWLEDGMENT OR NEGATIVE ACKNOWLEDGMENT FRAME,
+//  DATA FRAMES ARE BUILT ONCE, IN THE WINDOW
+void transmit_frame(FRAMEKIND kind, CnetAddr srcaddr, CnetAddr destaddr, int seqno, int ackno, int link, int hop_count)
+{
+    FRAME       *frame = FRAMEPOOL_alloc();
+
+    if (frame == NULL){
+        LOG(LOG_ERROR, "out of memory, %s to %d dropped\n", kind == DL_NAK ? "NAK" : "ACK", destaddr);
+        return;
+    }
 
     //  INITIALISE THE FRAME'S HEADER FIELDS
-    frame.src       = srcaddr;
-    frame.dest      = destaddr;
-    frame.seq       = seqno;
-    frame.ack       = ackno;
-    frame.checksum  = 0;
-    frame.len       = length;
-
-    
-    if (ackno < 0){
-        if (seqno > -1){
-            frame.hop_count = hop_count;
-            // DATA transmit
-            CnetTime	timeout;
-
-            printf("DATA transmitted:  ");
-            FRAME_print (&frame);
-            memcpy(&frame.msg, msg, length);
-
-            if (srcaddr == nodeinfo.address){
-                frame.hop_count = 0;
-                timeout =
-                    FRAME_SIZE(frame)*((CnetTime)8000000 / linkinfo[link].bandwidth) +
-                            linkinfo[link].propagationdelay;
-
-                swconn.lasttimer = CNET_start_timer(EV_TIMER1, 9 * timeout, 0);
-            }
+    frame->src       = srcaddr;
+    frame->dest      = destaddr;
+    frame->kind      = kind;
+    frame->seq       = seqno;
+    frame->ack       = ackno;
+    frame->len       = 0;
+    frame->codec     = CODEC_STORE;
+    frame->hop_count = hop_count;
+
+    FRAME_log(kind == DL_NAK ? "NAK sent" : "ACK sent", frame);
+
+    //  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
+    frame->datasum	= checksum(&frame->msg, frame->len);
+    write_frame(frame, link, TR_SEND);
+    FRAMEPOOL_release(frame);
+}
+
+//  SEND A DATA FRAME FROM THE WINDOW, CARRYING ANY ACK WE OWE ITS DESTINATION. AN ACK ALREADY
+//  IN THE FRAME IS LEFT THERE IF WE OWE NONE, AS A COPY OF THE FRAME MAY STILL BE QUEUED WITH IT
+void transmit_data(FRAME *f, int link, TRACEEVENT ev)
+{
+    int     ackno = take_ack(f->dest);
+
+    if (ackno > -1){
+        f->ack = ackno;
+    }
+    FRAME_log("DATA transmitted", f);
+    write_frame(f, link, ev);
+}
+
+//  PASS ON A FRAME FOR ANOTHER HOST, PATCHING THE HEADER CHECKSUM FOR THE NEW HOP COUNT
+//  SO THE PAYLOAD IS NEVER READ
+void forward_frame(FRAME *f, size_t length, int link)
+{
+    int     oldhops = f->hop_count;
+
+    f->hop_count += 1;
+    f->hdrsum = inet_checksum_update(f->hdrsum, oldhops, f->hop_count);
+    FRAME_log(f->kind == DL_DATA ? "DATA transmitted" : (f->kind == DL_ACK ? "ACK transmitted" :
+        (f->kind == DL_NAK ? "NAK transmitted" : "PARITY transmitted")), f);
+    TRACE_FRAME(TR_FORWARD, f, link, length);
+    METRICS_count(M_FORWARDED);
+    METRICS_tx(link, length);
+    LINKQUEUE_write(link, f, length);
+}
+
+//  THE TIME TO SERIALIZE A FRAME ONTO A LINK
+CnetTime frame_time(FRAME *f, int link)
+{
+    return FRAME_SIZE((*f))*((CnetTime)8000000 / linkinfo[link].bandwidth);
+}
+
+//  THE LINK A FRAME IN THE WINDOW WENT OUT ON, OR IF IT WENT OUT ON EVERY LINK, THE ONE ITS ACK
+//  CAME BACK ON, AS THAT IS THE WAY THAT GOT THROUGH FIRST
+int sent_link(SWCONN *conn, int slot, int acklink)
+{
+    return (conn->sentlink[slot] > 0) ? conn->sentlink[slot] : acklink;
+}
+
+//  UPDATE THE ROUND TRIP TIME OF THE PATH TO A HOST FROM THE ACK OF A FRAME THAT WAS SENT ONLY
+//  ONCE (KARN), carried IS THE TIME THE ACK SPENT BEING SERIALIZED BEHIND A PIGGYBACKED PAYLOAD
+void rtt_sample(SWCONN *conn, PEER *peer, int slot, int link, int hop_count, CnetTime carried)
+{
+    FRAME       *f = conn->window[slot];
+    PATH        *path = &peer->path[sent_link(conn, slot, link)];
+    CnetTime    rtt, delta;
+
+    if (conn->retransmitted[slot]){
+        return;
+    }
+    // the ack has crossed every link of the round trip, the data frame about half of them
+    path->hops = (hop_count + 1) / 2;
+    if (path->hops < 1){
+        path->hops = 1;
+    }
+    rtt = nodeinfo.time_in_usec - conn->sendtime[slot] - path->hops * frame_time(f, link) - carried;
+    if (rtt < 1){
+        rtt = 1;
+    }
+    METRICS_sample(H_RTT, rtt);
+    if (path->srtt == 0){
+        path->srtt = rtt;
+        path->rttvar = rtt / 2;
+    }
+    else {
+        delta = rtt - path->srtt;
+        path->srtt += delta / 8;
+        path->rttvar += ((delta < 0 ? -delta : delta) - path->rttvar) / 4;
+    }
+    path->backoff = 0;
+    path->loss -= path->loss / LOSS_WEIGHT;
+}
+
+//  A FRAME SENT ON THE PATH TO A HOST OUT OF link HAS TIMED OUT, BACK OFF AND COUNT IT AS LOST.
+//  RETURN 1 IF THAT HAS TAKEN THE PATH DOWN
+int path_timeout(PEER *peer, int link)
+{
+    PATH    *path = &peer->path[link];
+
+    // the frame or its ack may be stuck behind a burst of traffic
+    if (path->backoff < MAX_BACKOFF){
+        path->backoff++;
+    }
+    path->loss += (1.0 - path->loss) / LOSS_WEIGHT;
+    if (path->down || ++path->timeouts < PATH_DOWN_TIMEOUTS){
+        return 0;
+    }
+    path->down = 1;
+    LOG(LOG_INFO, "path to %d on link %d is down\n", peer->addr, link);
+    if (peer->probetimer == NULLTIMER){
+        peer->probetimer = CNET_start_timer(EV_TIMER3, PROBE_INTERVAL, (CnetData)peer->addr);
+    }
+    return 1;
+}
+
+//  AN ACK FROM A HOST HAS COME BACK ON link, SO THE PATH THAT WAY IS UP
+void path_heard(PEER *peer, int link)
+{
+    PATH    *path = &peer->path[link];
+
+    path->timeouts = 0;
+    if (path->down){
+        path->down = 0;
+        LOG(LOG_INFO, "path to %d on link %d is up\n", peer->addr, link);
+    }
+}
+
+//  HOW LONG TO WAIT FOR THE ACK OF A FRAME BEFORE SENDING IT AGAIN
+CnetTime retransmit_timeout(FRAME *f, int link)
+{
+    PEER        *peer = PEER_find(f->dest);
+    PATH        *path;
+    CnetTime	timeout;
+
+    if (peer == NULL || peer->path[link].srtt == 0){
+        // no estimate yet, be generous
+        return 9 * (frame_time(f, link) + linkinfo[link].propagationdelay);
+    }
+    path = &peer->path[link];
+    timeout = path->srtt + 4 * path->rttvar + path->hops * frame_time(f, link);
+    if (timeout < RTO_MIN){
+        timeout = RTO_MIN;
+    }
+    timeout <<= path->backoff;
+    if (timeout > RTO_MAX){
+        timeout = RTO_MAX;
+    }
+    return timeout;
+}
+
+//  START THE RETRANSMISSION TIMER OF A FRAME. THE TIMER'S DATA IS THE DESTINATION, WHICH FINDS
+//  THE CONNECTION, AND THE TIMER ITSELF TELLS WHICH FRAME IN THE WINDOW IT BELONGS TO
+void start_timer(SWCONN *conn, FRAME *f, int link)
+{
+    CnetTimerID timer;
+
+    timer = CNET_start_timer(EV_TIMER1, retransmit_timeout(f, link), (CnetData)conn->dest);
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        conn->timers[f->seq % WINDOW_SIZE] = timer;
+    }
+    else {
+        conn->lasttimer = timer;
+    }
+}
+
+//  MULTIPATH: THE LINK ON WHICH A FRAME SHOULD REACH ITS HOST FIRST. ON EACH PATH IT WAITS FOR THE
+//  BYTES QUEUED AHEAD OF IT, IS SERIALIZED ONTO EVERY HOP AND TAKES HALF THE ROUND TRIP, AND A
+//  PATH THAT LOSES FRAMES HAS TO CARRY SOME OF THEM TWICE. A PATH NOT MEASURED YET LOOKS LIKE A
+//  SINGLE HOP, SO IT IS TRIED
+int stripe_link(PEER *peer, FRAME *f)
+{
+    int     best = 0, up = 0;
+    double  bestcost = 0.0;
+
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        up += !peer->path[link].down;
+    }
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        PATH    *path = &peer->path[link];
+        double  cost;
+
+        // a path that is down only gets frames if every path is
+        if (path->down && up > 0){
+            continue;
+        }
+        cost = LINKQUEUE_bytes(link) * (8000000.0 / linkinfo[link].bandwidth) +
+                path->hops * frame_time(f, link) + path->srtt / 2.0;
+        cost /= 1.0 - (path->loss < LOSS_MAX ? path->loss : LOSS_MAX);
+        if (best == 0 || cost < bestcost){
+            best = link;
+            bestcost = cost;
         }
     }
+    return (best > 0) ? best : 1;
+}
+
+//  THE LINK TO SEND A DATA FRAME TO A HOST ON: THE SHORTEST PATH WHILE IT IS UP, ELSE THE PATH
+//  WITH THE FEWEST HOPS THAT IS, ELSE THE SHORTEST PATH ANYWAY. 0 IF WE DON'T KNOW A PATH YET.
+//  A PATH THAT HAS HAD AN ACK MEASURED BEATS ONE THAT HASN'T, WHOSE HOP COUNT IS ONLY A GUESS
+int route_link(CnetAddr dest)
+{
+    ROUTE   *route = ADDRTABLE_find(&routes, dest);
+    PEER    *peer = PEER_lookup(dest);
+    int     best = 0;
+
+    if (route == NULL || route->link == 0){
+        return 0;
+    }
+    if (peer == NULL || !peer->path[route->link].down){
+        return route->link;
+    }
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        PATH    *path = &peer->path[link];
+        int     measured = path->srtt > 0, bestmeasured = best > 0 && peer->path[best].srtt > 0;
+
+        if (path->down){
+            continue;
+        }
+        if (best == 0 || measured > bestmeasured ||
+                (measured == bestmeasured && path->hops < peer->path[best].hops)){
+            best = link;
+        }
+    }
+    return (best > 0) ? best : route->link;
+}
+
+//  NOTE THE LINK A FRAME FROM THE WINDOW HAS JUST GONE OUT ON, 0 FOR EVERY LINK
+void set_sent_link(SWCONN *conn, FRAME *f, int link)
+{
+    conn->sentlink[f->seq % WINDOW_SIZE] = link;
+    conn->epochwire += FRAME_SIZE((*f)) * (link > 0 ? 1 : nodeinfo.nlinks);
+}
+
+//  SEND A FRAME FROM THE WINDOW ON THE SHORTEST PATH, OR ON EVERY LINK IF WE DON'T KNOW IT YET.
+//  WITH MULTIPATH IT GOES ON WHICHEVER PATH SHOULD DELIVER IT FIRST
+void send_window_frame(SWCONN *conn, FRAME *f)
+{
+    int link = route_link(f->dest);
+    PEER *peer = MULTIPATH ? PEER_find(f->dest) : NULL;
+
+    if (peer != NULL){
+        link = stripe_link(peer, f);
+        transmit_data(f, link, TR_SEND);
+        set_sent_link(conn, f, link);
+    }
+    // check if the destaddr has the shortest path
+    else if (link > 0){
+        transmit_data(f, link, TR_SEND);
+        set_sent_link(conn, f, link);
+    }
     else {
-        // ACK transmit
-        frame.hop_count = hop_count;
-        if (srcaddr == nodeinfo.address){
-            printf("ACK sent:  ");
+        // the same buffer goes out on every link
+        for (int i = 1; i <= nodeinfo.nlinks; i++){
+            transmit_data(f, i, TR_SEND);
+        }
+        set_sent_link(conn, f, 0);
+        link = 1;
+    }
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT || conn->nbuffered == 1){
+        start_timer(conn, f, link);
+    }
+}
+
+//  SEND A FRAME FROM THE WINDOW AGAIN
+void retransmit_frame(SWCONN *conn, int seq, int link)
+{
+    transmit_data(conn->window[seq % WINDOW_SIZE], link, TR_RESEND);
+    METRICS_count(M_RETRANSMIT);
+    conn->retransmitted[seq % WINDOW_SIZE] = 1;
+    set_sent_link(conn, conn->window[seq % WINDOW_SIZE], link);
+}
+
+//  SELECTIVE REPEAT: A PATH HAS GONE DOWN, SO SEND EVERY FRAME STILL WAITING ON IT, BUT THE ONE
+//  WHOSE TIMEOUT TOOK IT DOWN, AGAIN ON ANOTHER PATH RATHER THAN WAITING FOR EACH ONE TO TIME OUT
+void reroute_window(SWCONN *conn, PEER *peer, int downlink, int timedout)
+{
+    int     seq = conn->ackexpected;
+
+    for (int i = 0; i < conn->nbuffered; i++){
+        int     slot = seq % WINDOW_SIZE;
+        int     link;
+
+        if (seq != timedout && conn->acked[slot] == 0 && conn->sentlink[slot] == downlink){
+            link = MULTIPATH ? stripe_link(peer, conn->window[slot]) : route_link(conn->dest);
+            if (link > 0 && link != downlink){
+                CNET_stop_timer(conn->timers[slot]);
+                retransmit_frame(conn, seq, link);
+                start_timer(conn, conn->window[slot], link);
+            }
         }
-        else{
-            printf("ACK transmitted:  ");
+        increment(seq);
+    }
+}
+
+//  GO-BACK-N: SEND EVERY OUTSTANDING FRAME AGAIN, OLDEST FIRST, AND RESTART THE TIMER
+void retransmit_window(SWCONN *conn, int link)
+{
+    int     seq = conn->ackexpected;
+
+    for (int i = 0; i < conn->nbuffered; i++){
+        retransmit_frame(conn, seq, link);
+        increment(seq);
+    }
+    if (conn->nbuffered > 0){
+        start_timer(conn, conn->window[conn->ackexpected % WINDOW_SIZE], link);
+    }
+}
+
+//  FEC_M: THE FIELDS OF A DATA FRAME'S HEADER THAT A REBUILT FRAME NEEDS BACK, AS BYTES TO ENCODE
+void fec_meta(FRAME *f, uint8_t meta[4])
+{
+    meta[0] = f->len & 0xff;
+    meta[1] = (f->len >> 8) & 0xff;
+    meta[2] = (f->len >> 16) & 0xff;
+    meta[3] = (uint8_t)(f->more | (f->codec << 1));
+}
+
+//  FEC_M: SEND THE PARITY FRAMES OF A BLOCK AFTER ITS LAST DATA FRAME, ON THE SAME PATH, OR WITH
+//  MULTIPATH ON WHICHEVER PATH SHOULD DELIVER EACH ONE FIRST. THEY ARE NEVER SENT AGAIN
+void send_parity(SWCONN *conn, FRAME *last)
+{
+    int     link = conn->sentlink[last->seq % WINDOW_SIZE];
+    PEER    *peer = MULTIPATH ? PEER_find(conn->dest) : NULL;
+
+    for (int j = 0; j < FEC_M; j++){
+        FRAME   *p = conn->parity[j];
+        uint8_t *meta = conn->paritymeta[j];
+
+        p->src       = nodeinfo.address;
+        p->dest      = conn->dest;
+        p->kind      = DL_PARITY;
+        p->seq       = last->seq - (FEC_K - 1);
+        p->ack       = (int)(meta[0] | (meta[1] << 8) | (meta[2] << 16) | ((uint32_t)meta[3] << 24));
+        p->more      = j;
+        p->len       = conn->paritylen;
+        p->codec     = CODEC_STORE;
+        p->hop_count = 0;
+        p->datasum   = checksum(&p->msg, p->len);
+        FRAME_log("PARITY sent", p);
+        if (peer != NULL){
+            write_frame(p, stripe_link(peer, p), TR_SEND);
         }
-        FRAME_print (&frame);
+        else if (link > 0){
+            write_frame(p, link, TR_SEND);
+        }
+        else {
+            for (int i = 1; i <= nodeinfo.nlinks; i++){
+                write_frame(p, i, TR_SEND);
+            }
+        }
+        conn->epochwire += FRAME_SIZE((*p)) * ((peer != NULL || link > 0) ? 1 : nodeinfo.nlinks);
+        FRAMEPOOL_release(p);
+        conn->parity[j] = NULL;
     }
-    
+}
 
-    //  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
-    length		= FRAME_SIZE(frame);
-    frame.checksum	= CNET_ccitt((unsigned char *)&frame, length);
-    CHECK(CNET_write_physical(link, &frame, &length));
+//  FEC_M: ADD A DATA FRAME, AS IT FIRST GOES OUT, TO THE PARITY FRAMES OF ITS BLOCK, AND SEND THEM
+//  ONCE IT IS THE LAST OF THE BLOCK. THE PARITY IS WORKED OUT FROM THE FRAME WHERE IT IS
+void fec_add(SWCONN *conn, FRAME *f)
+{
+    int         i = f->seq % FEC_K;
+    uint8_t     meta[4];
+    uint8_t     *payload[FEC_PARITY], *metaparity[FEC_PARITY];
+
+    if (FEC_M == 0){
+        return;
+    }
+    if (i == 0){
+        // a new block, the link queues hold any parity frames of the last one still waiting
+        for (int j = 0; j < FEC_M; j++){
+            conn->parity[j] = FRAMEPOOL_alloc();
+            memset(conn->paritymeta[j], 0, 4);
+        }
+        for (int j = 0; j < FEC_M; j++){
+            if (conn->parity[j] == NULL){
+                LOG(LOG_ERROR, "out of memory, no parity for the frames to %d\n", conn->dest);
+                for (j = 0; j < FEC_M; j++){
+                    FRAMEPOOL_release(conn->parity[j]);
+                    conn->parity[j] = NULL;
+                }
+                break;
+            }
+        }
+        conn->paritylen = 0;
+    }
+    if (conn->parity[0] == NULL){
+        return;
+    }
+    // a payload longer than any before it in the block adds zeros to the parity as far as it goes
+    if (f->len > conn->paritylen){
+        for (int j = 0; j < FEC_M; j++){
+            memset(&conn->parity[j]->msg.data[conn->paritylen], 0, f->len - conn->paritylen);
+        }
+        conn->paritylen = f->len;
+    }
+    for (int j = 0; j < FEC_M; j++){
+        payload[j] = (uint8_t *)conn->parity[j]->msg.data;
+        metaparity[j] = conn->paritymeta[j];
+    }
+    fec_meta(f, meta);
+    fec_encode(FEC_M, i, meta, sizeof(meta), metaparity);
+    fec_encode(FEC_M, i, &f->msg, f->len, payload);
+    if (i == FEC_K - 1){
+        send_parity(conn, f);
+    }
+}
+
+//  ADD A NEW FRAME, WITH ITS PAYLOAD ALREADY IN PLACE, TO THE WINDOW OF A CONNECTION AND SEND IT.
+//  THE WINDOW TAKES OVER THE REFERENCE TO THE FRAME
+void send_message(SWCONN *conn, FRAME *f, size_t length, int more)
+{
+    f->src       = nodeinfo.address;
+    f->dest      = conn->dest;
+    f->kind      = DL_DATA;
+    f->seq       = conn->nextframetosend;
+    f->ack       = -1;
+    f->more      = more;
+    f->len       = length;
+    f->codec     = conn->pendingcodec;
+    f->hop_count = 0;
+    f->datasum   = checksum(&f->msg, length);
+    conn->window[f->seq % WINDOW_SIZE] = f;
+    conn->acked[f->seq % WINDOW_SIZE] = 0;
+    conn->sendtime[f->seq % WINDOW_SIZE] = nodeinfo.time_in_usec;
+    conn->retransmitted[f->seq % WINDOW_SIZE] = 0;
+    conn->nbuffered++;
+
+    send_window_frame(conn, f);
+    if (FEC_M > 0){
+        fec_add(conn, f);
+    }
+
+    // increment # for nextframetosend
+    increment(conn->nextframetosend);
+}
+
+//  THE LARGEST PAYLOAD TO PUT IN A FRAME TO THE HOST OF A CONNECTION
+size_t frag_size(SWCONN *conn)
+{
+    return (FRAG_SIZE == FRAG_ADAPTIVE) ? conn->fragsize : FRAG_SIZE;
+}
+
+//  FRAG_ADAPTIVE: AT THE END OF AN EPOCH, KEEP CHANGING THE FRAGMENT SIZE THE SAME WAY IF THAT
+//  SENT FEWER BYTES FOR EACH BYTE ACKNOWLEDGED, ELSE TURN BACK
+void frag_adapt(SWCONN *conn)
+{
+    double  efficiency = (conn->epochwire > 0) ? (double)conn->epochpayload / conn->epochwire : 0.0;
+
+    if (efficiency < conn->efficiency){
+        conn->fragstep = -conn->fragstep;
+    }
+    conn->efficiency = efficiency;
+    if (conn->fragstep > 0 && conn->fragsize * 2 <= MAX_MESSAGE_SIZE){
+        conn->fragsize *= 2;
+    }
+    else if (conn->fragstep < 0 && conn->fragsize / 2 >= FRAG_MIN){
+        conn->fragsize /= 2;
+    }
+    conn->epochframes = 0;
+    conn->epochpayload = 0;
+    conn->epochwire = 0;
+}
+
+//  CUT THE PENDING MESSAGE OF A CONNECTION INTO FRAGMENTS WHILE THE WINDOW HAS ROOM FOR THEM.
+//  THE FIRST FRAGMENT IS THE BUFFER THE MESSAGE WAS READ INTO, SO A MESSAGE THAT FITS IN ONE
+//  FRAGMENT IS NEVER COPIED, AND THE OTHERS ARE COPIED FROM IT
+void fill_window(SWCONN *conn)
+{
+    while (conn->pending != NULL && conn->nbuffered < WINDOW_SIZE){
+        size_t  n = conn->pendinglen - conn->pendingoff;
+        FRAME   *f;
+
+        if (n > frag_size(conn)){
+            n = frag_size(conn);
+        }
+        if (conn->pendingoff == 0){
+            // the frame's header is written over the pending message's, its payload is left alone
+            f = FRAMEPOOL_hold(conn->pending);
+        }
+        else if ((f = FRAMEPOOL_alloc()) != NULL){
+            memcpy(&f->msg, &conn->pending->msg.data[conn->pendingoff], n);
+        }
+        else if (conn->nbuffered > 0){
+            return;           // try again when an ack has freed a buffer
+        }
+        else {
+            LOG(LOG_ERROR, "out of memory, message to %d dropped\n", conn->dest);
+            FRAMEPOOL_release(conn->pending);
+            conn->pending = NULL;
+            return;
+        }
+        conn->pendingoff += n;
+        send_message(conn, f, n, conn->pendingoff < conn->pendinglen);
+        if (conn->pendingoff == conn->pendinglen){
+            FRAMEPOOL_release(conn->pending);
+            conn->pending = NULL;
+        }
+    }
+}
+
+//  SEND WHAT THE WINDOW HAS ROOM FOR, THEN HOLD BACK MESSAGES FOR THIS HOST WHILE ITS WINDOW IS
+//  FULL OR A MESSAGE IS STILL BEING CUT UP, OR LET THEM FLOW AGAIN. THE OTHERS HAVE WINDOWS OF THEIR OWN
+void window_changed(SWCONN *conn)
+{
+    int     full;
+
+    fill_window(conn);
+    full = (conn->pending != NULL || conn->nbuffered == WINDOW_SIZE);
+    if (full && !conn->blocked){
+        conn->blocked = 1;
+        CNET_disable_application(conn->dest);
+    }
+    else if (!full && conn->blocked){
+        conn->blocked = 0;
+        CNET_enable_application(conn->dest);
+    }
+}
+
+//  COMPRESS A MESSAGE READ INTO f IF THAT SAVES ENOUGH, RETURN THE FRAME THAT NOW HOLDS IT, WITH
+//  *length AND *codec SET FOR IT. A MESSAGE THAT IS STORED STAYS IN f
+FRAME *compress_frame(FRAME *f, size_t *length, CODEC *codec)
+{
+    FRAME       *z = FRAMEPOOL_alloc();
+    size_t      zlen;
+
+    *codec = CODEC_STORE;
+    if (z == NULL){
+        return f;
+    }
+    *codec = compress_message(&f->msg, *length, &z->msg, &zlen);
+    if (*codec == CODEC_STORE){
+        FRAMEPOOL_release(z);
+        return f;
+    }
+    METRICS_count(M_COMPRESSED);
+    FRAMEPOOL_release(f);
+    *length = zlen;
+    return z;
 }
 
 //  THE APPLICATION LAYER HAS A NEW MESSAGE TO BE DELIVERED
 EVENT_HANDLER(application_ready)
 {
-    CnetAddr destaddr;
-    FRAME   lastframe;
-    int    link;
+    CnetAddr    destaddr;
+    FRAME       *f = FRAMEPOOL_alloc();
+    size_t      length = sizeof(MSG);
+    MSG         discard;
+    SWCONN      *conn;
+    CODEC       codec;
 
-    lastmsglength  = sizeof(MSG);
-    CHECK(CNET_read_application(&destaddr, &lastmsg, &lastmsglength));
-    CNET_disable_application(ALLNODES);
+    if (f == NULL){
+        // the message must still be taken, or the application layer stalls
+        CHECK(CNET_read_application(&destaddr, &discard, &length));
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        return;
+    }
+    // the message goes straight into the frame that will carry it, or its first fragment,
+    // unless it is compressed into another
+    CHECK(CNET_read_application(&destaddr, &f->msg, &length));
+    f = compress_frame(f, &length, &codec);
+    conn = SWCONN_find(destaddr);
+    if (conn == NULL){
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        FRAMEPOOL_release(f);
+        return;
+    }
+    conn->pending = f;
+    conn->pendinglen = length;
+    conn->pendingoff = 0;
+    conn->pendingcodec = codec;
+    window_changed(conn);
+}
 
-    int ackno = -1;
-    int have_shortest_path = 0;
-    // check if the destaddr has the shortest path
-    for (int i = 0; i < 14; i++){
-        if (swconn.host_list[i] == destaddr){
-            if (swconn.found_shortest_path[i] > 0){
-                have_shortest_path = 1;
-                link = swconn.found_shortest_path[i];
-                transmit_frame(nodeinfo.address, destaddr, &lastmsg, lastmsglength, nextdatatosend, ackno, link, 0);
-                break;
+//  ASK THE SENDER FOR THE FRAME WE ARE WAITING FOR, ONCE PER FRAME
+void send_nak(PEER *peer, int link, int hop_count)
+{
+    if (USE_NAKS && peer->nak_sent == 0){
+        peer->nak_sent = 1;
+        transmit_frame(DL_NAK, nodeinfo.address, peer->addr, peer->frameexpected, -1, link, hop_count);
+    }
+}
+
+//  SEND THE ACK WE OWE A HOST IN A FRAME OF ITS OWN. WITH SELECTIVE REPEAT IT ALSO ACKNOWLEDGES
+//  seq ALONE, UNLESS seq IS -1
+void send_ack(PEER *peer, int seq)
+{
+    if (peer->ackpending){
+        peer->ackpending = 0;
+        peer->ackcount = 0;
+        CNET_stop_timer(peer->acktimer);
+        peer->acktimer = NULLTIMER;
+        METRICS_count(M_ACKS);
+        transmit_frame(DL_ACK, nodeinfo.address, peer->addr, seq, peer->ackno, peer->acklink, peer->ackhops);
+    }
+}
+
+//  NOTE THE CUMULATIVE ACK WE OWE A HOST, FOR A FRAME THAT ARRIVED ON link
+void owe_ack(PEER *peer, int link, int hop_count)
+{
+    peer->ackno = (peer->frameexpected + MAX_SEQ) % (MAX_SEQ + 1);
+    peer->acklink = link;
+    peer->ackhops = hop_count;
+    peer->ackpending = 1;
+}
+
+//  HOLD AN ACK FOR count MORE FRAMES RECEIVED IN ORDER BACK FOR A WHILE, IN CASE A DATA FRAME TO THE
+//  SAME HOST CAN CARRY IT OR MORE FRAMES ARRIVE FOR IT TO COVER, BUT NOT PAST ACK_EVERY FRAMES
+void schedule_ack(PEER *peer, int count, int link, int hop_count)
+{
+    owe_ack(peer, link, hop_count);
+    peer->ackcount += count;
+    if (ACK_DELAY == 0 || peer->ackcount >= ACK_EVERY){
+        send_ack(peer, -1);
+    }
+    else if (peer->acktimer == NULLTIMER){
+        peer->acktimer = CNET_start_timer(EV_TIMER2, ACK_DELAY, (CnetData)peer->addr);
+    }
+}
+
+//  FEC_M: 1 IF THE PARITY FRAMES MAY REBUILD THE FRAME WE ARE WAITING FOR SOONER THAN A NAK, NOW
+//  THAT FRAME seq HAS ARRIVED, OR ARRIVED DAMAGED. ONLY IF seq IS THE LAST DATA FRAME OF THE SAME
+//  BLOCK, SO ITS PARITY COMES NEXT, AND NO MORE OF THE BLOCK IS MISSING THAN THE PARITY CAN REBUILD.
+//  THE REST OF A BLOCK MAY BE A LONG TIME COMING WHILE THE SENDER HAS LITTLE TO SEND
+int fec_pending(PEER *peer, int seq)
+{
+    int     block = peer->frameexpected - peer->frameexpected % FEC_K;
+    int     b = (block / FEC_K) % FEC_BLOCKS;
+    int     missing = 0;
+
+    if (FEC_M == 0 || seq - seq % FEC_K != block || seq % FEC_K != FEC_K - 1){
+        return 0;
+    }
+    for (int i = 0; i < seq % FEC_K; i++){
+        missing += (peer->fecblock[b] != block || peer->fecdata[b][i] == NULL);
+    }
+    return missing <= FEC_M;
+}
+
+//  A FRAME HAS ARRIVED AHEAD OF ONE THAT IS MISSING. SELECTIVE REPEAT ACKNOWLEDGES IT ALONE AT ONCE,
+//  SO THE SENDER WON'T SEND IT AGAIN, AND THE SENDER IS TOLD OF THE GAP ONCE, WITH A NAK FOR THE
+//  MISSING FRAME, OR IF THERE IS NONE, WITH THE CUMULATIVE ACK AT ONCE. STRIPED FRAMES ARRIVE OUT OF
+//  ORDER ALL THE TIME, SO THEY ARE NOT NAKED, AND NOR IS A GAP THE PARITY FRAMES MAY YET FILL
+void frame_ahead(PEER *peer, int seq, int link, int hop_count)
+{
+    int     pending = fec_pending(peer, seq);
+
+    if (!MULTIPATH && !pending){
+        send_nak(peer, link, hop_count);
+    }
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        owe_ack(peer, link, hop_count);
+        send_ack(peer, seq);
+    }
+    else if (peer->nak_sent == 0 && !pending){
+        peer->nak_sent = 1;
+        owe_ack(peer, link, hop_count);
+        send_ack(peer, -1);
+    }
+}
+
+//  A FRAME HAS LEFT THE WINDOW, DROP THE WINDOW'S REFERENCE TO IT
+void release_frame(SWCONN *conn, int seq)
+{
+    METRICS_sample(H_ACKED, nodeinfo.time_in_usec - conn->sendtime[seq % WINDOW_SIZE]);
+    conn->epochpayload += conn->window[seq % WINDOW_SIZE]->len;
+    if (++conn->epochframes >= FRAG_EPOCH && FRAG_SIZE == FRAG_ADAPTIVE){
+        frag_adapt(conn);
+    }
+    FRAMEPOOL_release(conn->window[seq % WINDOW_SIZE]);
+    conn->window[seq % WINDOW_SIZE] = NULL;
+}
+
+//  SELECTIVE REPEAT: THE RECEIVER HAS A FRAME IN THE WINDOW, STOP ITS TIMER. IF peer IS NOT NULL
+//  AND THIS IS THE FIRST WE HAVE HEARD OF IT, THE ACK ALSO GIVES THE ROUND TRIP TIME
+void selective_ack(SWCONN *conn, PEER *peer, int seq, int link, int hop_count, CnetTime carried)
+{
+    int     slot = seq % WINDOW_SIZE;
+
+    if (conn->acked[slot] == 0){
+        if (peer != NULL){
+            rtt_sample(conn, peer, slot, link, hop_count, carried);
+        }
+        conn->acked[slot] = 1;
+        CNET_stop_timer(conn->timers[slot]);
+    }
+}
+
+//  THE RECEIVER HAS ACKNOWLEDGED ONE OR MORE FRAMES, IN AN ACK FRAME OR PIGGYBACKED ON DATA
+void ack_received(FRAME *f, int link)
+{
+    SWCONN      *conn = SWCONN_lookup(f->src);
+    int         hop_count = f->hop_count;
+    CnetTime    carried = 0;
+
+    // ACK receive
+    FRAME_log("ACK received", f);
+    if (f->kind == DL_DATA){
+        // a piggybacked ack only made the trip back, behind a payload of its own
+        hop_count = 2 * f->hop_count + 1;
+        carried = (f->hop_count + 1) * frame_time(f, link);
+    }
+    if (conn != NULL && conn->nbuffered > 0 && ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        PEER *peer = PEER_find(f->src);
+        int seq = conn->ackexpected;
+
+        // an ack frame may acknowledge one frame that arrived out of order, as well as being cumulative,
+        // a seq of -1 names none, and between() would take it for a frame once the window wraps
+        if (f->kind == DL_ACK && f->seq >= 0 && between(conn->ackexpected, f->seq, conn->nextframetosend)){
+            selective_ack(conn, peer, f->seq, link, hop_count, carried);
+        }
+        if (between(conn->ackexpected, f->ack, conn->nextframetosend)){
+            // only the newest frame acknowledged gives the round trip time, the others waited for it
+            selective_ack(conn, peer, f->ack, link, hop_count, carried);
+            for ( ; seq != f->ack; increment(seq)){
+                selective_ack(conn, NULL, seq, link, hop_count, carried);
             }
         }
+        // the window slides past every acknowledged frame
+        while (conn->nbuffered > 0 && conn->acked[conn->ackexpected % WINDOW_SIZE]){
+            conn->acked[conn->ackexpected % WINDOW_SIZE] = 0;
+            release_frame(conn, conn->ackexpected);
+            conn->nbuffered--;
+            increment(conn->ackexpected);
+        }
     }
-    if (have_shortest_path == 0){
-        for (int i = 1; i <= nodeinfo.nlinks; i++){
-            transmit_frame(nodeinfo.address, destaddr, &lastmsg, lastmsglength, nextdatatosend, ackno, i, 0);
+    else if (conn != NULL && conn->nbuffered > 0 &&
+            between(conn->ackexpected, f->ack, conn->nextframetosend)){
+        PEER *peer = PEER_find(f->src);
+        int slot = f->ack % WINDOW_SIZE;
+
+        // the ack acknowledges every frame up to and including f->ack
+        if (peer != NULL){
+            rtt_sample(conn, peer, slot, link, hop_count, carried);
+        }
+        CNET_stop_timer(conn->lasttimer);
+        while (between(conn->ackexpected, f->ack, conn->nextframetosend)){
+            release_frame(conn, conn->ackexpected);
+            conn->nbuffered--;
+            increment(conn->ackexpected);
+        }
+        if (conn->nbuffered > 0){
+            start_timer(conn, conn->window[conn->ackexpected % WINDOW_SIZE], link);
         }
     }
-    // add to swconn
-    swconn.dest = destaddr;
+    // the ack came back this way, so the path is up
+    PEER *sender = PEER_lookup(f->src);
+    if (sender != NULL){
+        path_heard(sender, link);
+    }
 
-    lastframe.src       = nodeinfo.address;
-    lastframe.dest      = destaddr;
-    lastframe.seq       = nextdatatosend;
-    lastframe.ack       = ackno;
-    lastframe.checksum  = 0;
-    lastframe.len       = lastmsglength;
-    memcpy(&lastframe.msg, &lastmsg, lastmsglength);
-    swconn.lastframe = lastframe;
+    // update the shortest path table, the first ack or one that took fewer hops gives the path
+    ROUTE *route = ADDRTABLE_insert(&routes, f->src);
+    if (route != NULL && (route->link == 0 || route->hops > hop_count)){
+        route->link = link;
+        route->hops = hop_count;
+    }
 
-    // increment # for nextdatatosend
-    increment(nextdatatosend);
-    // add to swconn
-    swconn.nextframetosend = nextdatatosend;
+    // more fragments, or messages for this host, can go once its window has room
+    if (conn != NULL){
+        window_changed(conn);
+    }
 }
 
-//  PROCESS THE ARRIVAL OF A NEW FRAME, VERIFY CHECKSUM, ACT ON ITS FRAMEKIND
-EVENT_HANDLER(physical_ready)
+//  THE RECEIVER IS MISSING A FRAME, SEND IT AGAIN WITHOUT WAITING FOR ITS TIMER
+void nak_received(FRAME *f, int link)
 {
-    FRAME        frame;
-    int          link, arriving_checksum, stored_checksum;
-    size_t	 len = sizeof(FRAME);
+    SWCONN *conn = SWCONN_lookup(f->src);
+    int slot = f->seq % WINDOW_SIZE;
 
-    //  RECEIVE THE NEW FRAME
-    CHECK(CNET_read_physical(&link, &frame, &len));
+    FRAME_log("NAK received", f);
+    if (conn == NULL || conn->nbuffered == 0 ||
+            !between(conn->ackexpected, f->seq, conn->nextframetosend)){
+        return;
+    }
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        if (conn->acked[slot] == 0){
+            CNET_stop_timer(conn->timers[slot]);
+            retransmit_frame(conn, f->seq, link);
+            start_timer(conn, conn->window[slot], link);
+        }
+    }
+    else {
+        // every frame before the one asked for has arrived
+        while (conn->ackexpected != f->seq){
+            release_frame(conn, conn->ackexpected);
+            conn->nbuffered--;
+            increment(conn->ackexpected);
+        }
+        CNET_stop_timer(conn->lasttimer);
+        retransmit_window(conn, link);
+        window_changed(conn);
+    }
+}
 
-    if (frame.dest != nodeinfo.address){
-        frame.hop_count += 1;
-        // forward the frame to the next hop and update the frame
+//  WRITE A WHOLE MESSAGE FROM A HOST, len BYTES AT msg CARRIED WITH codec, TO THE APPLICATION,
+//  DECOMPRESSING IT FIRST INTO A BUFFER OF ITS OWN. f IS ITS LAST FRAME, FOR THE TRACE
+void write_message(PEER *peer, FRAME *f, MSG *msg, size_t len, CODEC codec)
+{
+    FRAME   *z = NULL;
+
+    if (codec != CODEC_STORE){
+        size_t  zlen = sizeof(MSG);
+
+        z = FRAMEPOOL_alloc();
+        if (z == NULL || decompress_message(codec, msg, len, &z->msg, &zlen) != 0){
+            LOG(LOG_ERROR, "message from %d could not be decompressed, dropped\n", peer->addr);
+            FRAMEPOOL_release(z);
+            return;
+        }
+        msg = &z->msg;
+        len = zlen;
+    }
+    CHECK(CNET_write_application(msg, &len));
+    METRICS_count(M_DELIVERED);
+    TRACE_FRAME(TR_DELIVER, f, 0, len);
+    FRAMEPOOL_release(z);
+}
+
+//  PASS A DATA FRAME THAT HAS ARRIVED IN ORDER UP TO THE APPLICATION, ONCE THE REST OF ITS MESSAGE
+//  IS IN. A MESSAGE THAT CAME IN ONE FRAME IS WRITTEN STRAIGHT FROM IT, THE FRAGMENTS OF A LONGER
+//  ONE ARE COPIED IN AFTER ITS FIRST FRAGMENT, WHICH IS KEPT
+void deliver(PEER *peer, FRAME *f)
+{
+    if (peer->reasm == NULL && !peer->reasmlost){
+        if (!f->more){
+            write_message(peer, f, &f->msg, f->len, f->codec);
+            return;
+        }
+        peer->reasm = FRAMEPOOL_hold(f);
+        peer->reasmlen = f->len;
+        return;
+    }
+    if (peer->reasm != NULL){
+        if (peer->reasmlen + f->len <= sizeof(MSG)){
+            memcpy(&peer->reasm->msg.data[peer->reasmlen], &f->msg, f->len);
+            peer->reasmlen += f->len;
+        }
+        else {
+            LOG(LOG_ERROR, "message from %d too long, dropped\n", peer->addr);
+            FRAMEPOOL_release(peer->reasm);
+            peer->reasm = NULL;
+            peer->reasmlost = 1;
+        }
+    }
+    if (!f->more){
+        if (peer->reasm != NULL){
+            // the first fragment says how the whole message was carried
+            write_message(peer, f, &peer->reasm->msg, peer->reasmlen, peer->reasm->codec);
+            FRAMEPOOL_release(peer->reasm);
+            peer->reasm = NULL;
+        }
+        peer->reasmlost = 0;
+    }
+}
+
+//  SELECTIVE REPEAT: BUFFER A DATA FRAME AND PASS ANY IN-ORDER RUN UP TO THE APPLICATION
+void receive_selective(PEER *peer, FRAME *f, int link)
+{
+    int     seq = peer->frameexpected;
+    int     windowend = (peer->frameexpected + WINDOW_SIZE) % (MAX_SEQ + 1);
+    int     slot = f->seq % WINDOW_SIZE;
+
+    if (!between(peer->frameexpected, f->seq, windowend)){
+        METRICS_count(M_DUPLICATE);
+        TRACE_FRAME(TR_DUPLICATE, f, link, FRAME_SIZE((*f)));
+        return;           // already delivered
+    }
+    if (peer->inbuf[slot] == NULL){
+        // keep the frame itself, not a copy of its message
+        peer->inbuf[slot] = FRAMEPOOL_hold(f);
+    }
+    else {
+        METRICS_count(M_DUPLICATE);
+        TRACE_FRAME(TR_DUPLICATE, f, link, FRAME_SIZE((*f)));
+    }
+    while (peer->inbuf[seq % WINDOW_SIZE] != NULL){
+        slot = seq % WINDOW_SIZE;
+        deliver(peer, peer->inbuf[slot]);
+        FRAMEPOOL_release(peer->inbuf[slot]);
+        peer->inbuf[slot] = NULL;
+        increment(seq);
+    }
+    if (seq != peer->frameexpected){
+        peer->frameexpected = seq;
+        peer->nak_sent = 0;
+    }
+}
+
+//  A DATA FRAME FROM A HOST HAS ARRIVED, OR BEEN REBUILT, PASS IT UP IF ITS TURN HAS COME AND
+//  ACKNOWLEDGE IT
+void data_received(PEER *peer, FRAME *frame, int link)
+{
+    int     expected = peer->frameexpected;
+    int     hop_count = frame->hop_count + 1;
+
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        receive_selective(peer, frame, link);
+    }
+    // only the next frame in sequence is accepted, anything else is a duplicate or out of order
+    else if (frame->seq == peer->frameexpected){
+        deliver(peer, frame);
+        increment(peer->frameexpected);
+        peer->nak_sent = 0;
+    }
+    else if (!between(peer->frameexpected, frame->seq, (peer->frameexpected + WINDOW_SIZE) % (MAX_SEQ + 1))){
+        METRICS_count(M_DUPLICATE);
+        TRACE_FRAME(TR_DUPLICATE, frame, link, FRAME_SIZE((*frame)));
+    }
+
+    if (peer->frameexpected != expected){
+        // in order, perhaps with frames that were waiting for it, acknowledge them together, perhaps on our next frame to frame->src
+        schedule_ack(peer, (peer->frameexpected - expected + MAX_SEQ + 1) % (MAX_SEQ + 1), link, hop_count);
+    }
+    else if (between(expected, frame->seq, (expected + WINDOW_SIZE) % (MAX_SEQ + 1))){
+        frame_ahead(peer, frame->seq, link, hop_count);
+    }
+    else {
+        // a duplicate, its ack may have been lost, so the sender is waiting for another
+        owe_ack(peer, link, hop_count);
+        send_ack(peer, -1);
+    }
+}
+
+//  FEC_M: THE PLACE OF THE BLOCK STARTING AT block AMONG THOSE BEING GATHERED FROM A HOST, LETTING
+//  GO OF THE OLDER BLOCK IN THAT PLACE. RETURN -1 IF block IS OLDER THAN THAT ONE
+int fec_block(PEER *peer, int block)
+{
+    int     b = (block / FEC_K) % FEC_BLOCKS;
+    int     old = peer->fecblock[b];
+
+    if (old == block){
+        return b;
+    }
+    if (old != -1 && !between(old, block, (old + (MAX_SEQ + 1) / 2) % (MAX_SEQ + 1))){
+        return -1;
+    }
+    for (int i = 0; i < FEC_K; i++){
+        FRAMEPOOL_release(peer->fecdata[b][i]);
+        peer->fecdata[b][i] = NULL;
+    }
+    for (int j = 0; j < FEC_M; j++){
+        FRAMEPOOL_release(peer->fecparity[b][j]);
+        peer->fecparity[b][j] = NULL;
+    }
+    peer->fecblock[b] = block;
+    return b;
+}
+
+//  FEC_M: ONCE ENOUGH OF BLOCK b FROM A HOST IS IN, REBUILD ITS DATA FRAMES THAT
+//  WERE LOST AND PASS THEM ON AS IF THEY HAD ARRIVED WITH frame. GO-BACK-N THREW AWAY THE FRAMES
+//  AFTER THE FIRST ONE LOST, SO THOSE ARE PASSED ON AGAIN. IF THE LAST PARITY FRAME IS IN AND
+//  THERE IS STILL TOO MUCH MISSING, ASK FOR THE FRAME WE ARE WAITING FOR
+void fec_repair(PEER *peer, int b, FRAME *frame, int link)
+{
+    const void  *data[FEC_K], *datameta[FEC_K];
+    size_t      len[FEC_K], metalen[FEC_K];
+    uint8_t     meta[FEC_K][4], parmeta[FEC_PARITY][4];
+    uint8_t     *parity[FEC_PARITY], *paritymeta[FEC_PARITY], *out[FEC_K], *outmeta[FEC_K];
+    FRAME       *rebuilt[FEC_K];
+    int         lost = 0, arrived = 0;
+    size_t      n = 0;
+
+    for (int j = 0; j < FEC_M; j++){
+        FRAME *p = peer->fecparity[b][j];
+
+        parity[j] = paritymeta[j] = NULL;
+        if (p != NULL){
+            uint32_t m = (uint32_t)p->ack;
+
+            arrived++;
+            n = p->len;
+            parmeta[j][0] = m & 0xff;
+            parmeta[j][1] = (m >> 8) & 0xff;
+            parmeta[j][2] = (m >> 16) & 0xff;
+            parmeta[j][3] = m >> 24;
+            parity[j] = (uint8_t *)p->msg.data;
+            paritymeta[j] = parmeta[j];
+        }
+    }
+    for (int i = 0; i < FEC_K; i++){
+        FRAME *f = peer->fecdata[b][i];
+
+        rebuilt[i] = NULL;
+        data[i] = datameta[i] = NULL;
+        out[i] = outmeta[i] = NULL;
+        len[i] = 0;
+        metalen[i] = sizeof(meta[i]);
+        if (f != NULL){
+            fec_meta(f, meta[i]);
+            data[i] = &f->msg;
+            datameta[i] = meta[i];
+            len[i] = f->len;
+        }
+        else {
+            lost++;
+        }
+    }
+    if (lost == 0 || arrived == 0){
+        return;
+    }
+    if (lost > arrived){
+        if (frame->kind == DL_PARITY && frame->more == FEC_M - 1){
+            send_nak(peer, link, frame->hop_count + 1);
+        }
+        return;
+    }
+    for (int i = 0; i < FEC_K; i++){
+        if (data[i] == NULL){
+            if ((rebuilt[i] = FRAMEPOOL_alloc()) == NULL){
+                LOG(LOG_ERROR, "out of memory, frames from %d not rebuilt\n", peer->addr);
+                for (i = 0; i < FEC_K; i++){
+                    FRAMEPOOL_release(rebuilt[i]);
+                }
+                return;
+            }
+            out[i] = (uint8_t *)rebuilt[i]->msg.data;
+            outmeta[i] = meta[i];
+        }
+    }
+    // the parity frames used are worked over, but every data frame of the block is in after this
+    fec_decode(FEC_K, FEC_M, datameta, metalen, paritymeta, outmeta, sizeof(meta[0]));
+    fec_decode(FEC_K, FEC_M, data, len, parity, out, n);
+    for (int i = 0; i < FEC_K; i++){
+        FRAME *f = rebuilt[i];
+
+        if (f == NULL){
+            continue;
+        }
+        f->src       = peer->addr;
+        f->dest      = nodeinfo.address;
+        f->kind      = DL_DATA;
+        f->seq       = peer->fecblock[b] + i;
+        f->ack       = -1;
+        f->more      = meta[i][3] & 1;
+        f->codec     = meta[i][3] >> 1;
+        f->len       = meta[i][0] | (meta[i][1] << 8) | ((size_t)meta[i][2] << 16);
+        f->hop_count = frame->hop_count;
+        peer->fecdata[b][i] = f;
+        METRICS_count(M_REBUILT);
+        TRACE_FRAME(TR_REBUILT, f, link, FRAME_SIZE((*f)));
+        FRAME_log("DATA rebuilt", f);
+    }
+    for (int i = 0; i < FEC_K; i++){
+        int seq = peer->fecblock[b] + i;
+
+        if ((rebuilt[i] != NULL || ARQ_MODE == ARQ_GO_BACK_N) &&
+                between(peer->frameexpected, seq, (peer->frameexpected + WINDOW_SIZE) % (MAX_SEQ + 1))){
+            data_received(peer, peer->fecdata[b][i], link);
+        }
+    }
+}
+
+//  FEC_M: KEEP A DATA OR PARITY FRAME FROM A HOST WITH THE REST OF ITS BLOCK, AND SEE IF ANY OF
+//  THE BLOCK CAN BE REBUILT NOW
+void fec_received(PEER *peer, FRAME *frame, int link)
+{
+    FRAME   **slot;
+    int     b;
+
+    if (frame->kind == DL_DATA){
+        if ((b = fec_block(peer, frame->seq - frame->seq % FEC_K)) < 0){
+            return;
+        }
+        slot = &peer->fecdata[b][frame->seq % FEC_K];
+    }
+    else {
+        if (frame->more < 0 || frame->more >= FEC_M || frame->seq % FEC_K != 0 ||
+                frame->len > sizeof(MSG) || (b = fec_block(peer, frame->seq)) < 0){
+            return;
+        }
+        slot = &peer->fecparity[b][frame->more];
+    }
+    if (*slot == NULL){
+        *slot = FRAMEPOOL_hold(frame);
+    }
+    fec_repair(peer, b, frame, link);
+}
+
+//  VERIFY THE CHECKSUMS OF A NEW FRAME, ACT ON ITS FRAMEKIND
+void frame_arrived(FRAME *frame, size_t len, int link)
+{
+    int          stored_checksum;
+
+    //  CHECK THE HEADER ON EVERY HOP, IGNORE THE FRAME IF IT IS DAMAGED
+    if (len < FRAME_HEADER_SIZE || inet_checksum(frame, FRAME_HEADER_SIZE) != 0 || FRAME_SIZE((*frame)) != len){
+        LOG(LOG_INFO, "BAD frame received:  header checksum\n");
+        METRICS_count(M_BADCHECKSUM);
+        TRACE(TR_BADCHECKSUM, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+        return;
+    }
+    TRACE_FRAME(TR_RECEIVE, frame, link, len);
+
+    if (frame->dest != nodeinfo.address){
+        // forward the frame to the next hop
         for(int i = 1; i <= nodeinfo.nlinks; i++){
             if (i != link){
-                transmit_frame(frame.src, frame.dest, &frame.msg, frame.len, frame.seq, frame.ack, i, frame.hop_count);
+                forward_frame(frame, len, i);
                 break;
             }
         }
     }
     else{
-        //  CALCULATE THE CHECKSUM OF THE ARRIVING FRAME, IGNORE IF INVALID
-        arriving_checksum	= frame.checksum;
-        frame.checksum  	= 0;
-        stored_checksum = CNET_ccitt((unsigned char *)&frame, len);
-        if(stored_checksum != arriving_checksum) {
-            printf("BAD frame received:  checksums  (stored=%d, computed=%d)\n", arriving_checksum, stored_checksum);
+        //  CALCULATE THE CHECKSUM OF THE PAYLOAD, ONLY THE DESTINATION DOES THIS
+        stored_checksum = checksum(&frame->msg, frame->len);
+        if(stored_checksum != frame->datasum) {
+            LOG(LOG_INFO, "BAD frame received:  checksums  (stored=%d, computed=%d)\n", frame->datasum, stored_checksum);
+            METRICS_count(M_BADCHECKSUM);
+            TRACE_FRAME(TR_BADCHECKSUM, frame, link, len);
+            // the header is good, so if this is data from a host we know, ask for the frame we are waiting
+            // for, unless the parity frames may yet rebuild it
+            PEER *peer = PEER_lookup(frame->src);
+            if (frame->kind == DL_DATA && peer != NULL && !fec_pending(peer, frame->seq)){
+                send_nak(peer, link, frame->hop_count + 1);
+            }
             return;           // bad checksum, just ignore frame
         }
 
 
-        //  use if statement to determine if frame is data or ack
-        if (frame.ack > -1){
-            // ACK receive
-            // if(frame.seq == swconn.ackexpected) {
-            printf("ACK received:  ");
-            FRAME_print (&frame);
-            CNET_stop_timer(swconn.lasttimer);
-            increment(swconn.ackexpected);
-            // update swconn shortest path table
-            for (int i = 0; i < 14; i++){
-                if (swconn.host_list[i] == -1){
-                    swconn.host_list[i] = frame.src;
-                    swconn.found_shortest_path[i] = link;
-                    swconn.host_hop_count[i] = frame.hop_count;
-                    break;
-                }
-                else if (swconn.host_list[i] == frame.src){
-                    if (swconn.host_hop_count[i] > frame.hop_count){
-                        swconn.found_shortest_path[i] = link;
-                        swconn.host_hop_count[i] = frame.hop_count;
-                    }
-                    break;
-                }
+        //  act on the kind of frame
+        if (frame->kind == DL_ACK){
+            ack_received(frame, link);
+        }
+        else if (frame->kind == DL_NAK){
+            nak_received(frame, link);
+        }
+        else if (frame->kind == DL_PARITY){
+            PEER *peer = PEER_find(frame->src);
+
+            FRAME_log("PARITY received", frame);
+            if (FEC_M > 0 && peer != NULL){
+                fec_received(peer, frame, link);
             }
-            
-            CNET_enable_application(ALLNODES);
-            // }
         }
         else {
             // DATA receive
-            printf("DATA received:  ");
-            FRAME_print (&frame);
-            len = frame.len;
-            if (strcmp(swconn.last_receive_msg.data, frame.msg.data) != 0){
-                CHECK(CNET_write_application(&frame.msg, &len));
-                memcpy(swconn.last_receive_msg.data,frame.msg.data, MAX_MESSAGE_SIZE);
-                increment(swconn.frameexpected);
+            PEER *peer = PEER_find(frame->src);
+
+            FRAME_log("DATA received", frame);
+            if (frame->ack > -1){
+                ack_received(frame, link);
+            }
+            if (peer == NULL){
+                return;
+            }
+            data_received(peer, frame, link);
+            if (FEC_M > 0){
+                fec_received(peer, frame, link);
             }
-            
-            int ackno = frame.seq;
-            frame.hop_count += 1;
-            transmit_frame(nodeinfo.address, frame.src, NULL, 0, frame.seq, ackno, link, frame.hop_count);	// acknowledge the data        
         }
     }
 }
 
-//  WHEN A TIMEOUT OCCURS, WE RE-TRANSMIT THE MOST RECENT DATA (MESSAGE)
+//  PROCESS THE ARRIVAL OF A NEW FRAME, READ INTO A BUFFER OF ITS OWN SO IT CAN BE FORWARDED
+//  OR KEPT WITHOUT BEING COPIED
+EVENT_HANDLER(physical_ready)
+{
+    FRAME        *frame = FRAMEPOOL_alloc();
+    FRAME        discard;
+    int          link;
+    size_t	 len = sizeof(FRAME);
+
+    if (frame == NULL){
+        CHECK(CNET_read_physical(&link, &discard, &len));
+        LOG(LOG_ERROR, "out of memory, frame dropped\n");
+        return;
+    }
+    //  RECEIVE THE NEW FRAME
+    CHECK(CNET_read_physical(&link, frame, &len));
+    METRICS_count(M_RECEIVED);
+    METRICS_rx(link, len);
+    frame_arrived(frame, len, link);
+    FRAMEPOOL_release(frame);
+}
+
+//  WHEN A TIMEOUT OCCURS, WE RE-TRANSMIT EVERY OUTSTANDING FRAME (GO-BACK-N)
+//  OR JUST THE FRAME WHOSE TIMER EXPIRED (SELECTIVE REPEAT). THE PATH IT WENT ON IS
+//  BACKED OFF, PERHAPS TAKEN DOWN, AND THE FRAME GOES ON THE BEST PATH THERE IS NOW
 EVENT_HANDLER(timeouts)
 {
-    FRAME   lastframe;
-    
-    int ackno = -1;
+    SWCONN  *conn = SWCONN_lookup((CnetAddr)data);
+    PEER    *peer = PEER_find((CnetAddr)data);
+    int     seq, link;
+
+    if (conn == NULL || conn->nbuffered == 0){
+        return;
+    }
+    seq = conn->ackexpected;
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        // find the frame whose timer this is
+        int i;
+
+        for (i = 0; i < conn->nbuffered; i++){
+            if (conn->timers[seq % WINDOW_SIZE] == timer && conn->acked[seq % WINDOW_SIZE] == 0){
+                break;
+            }
+            increment(seq);
+        }
+        if (i == conn->nbuffered){
+            return;
+        }
+    }
+    link = sent_link(conn, seq % WINDOW_SIZE, 1);
+    METRICS_count(M_TIMEOUT);
+    TRACE(TR_TIMEOUT, TK_DATA, nodeinfo.address, conn->dest, seq, -1, link, 0);
+    if (peer != NULL){
+        if (path_timeout(peer, link) && ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+            reroute_window(conn, peer, link, seq);
+        }
+        if (MULTIPATH){
+            link = stripe_link(peer, conn->window[seq % WINDOW_SIZE]);
+        }
+        else if (route_link(conn->dest) > 0){
+            link = route_link(conn->dest);
+        }
+    }
+
+    if (ARQ_MODE == ARQ_SELECTIVE_REPEAT){
+        retransmit_frame(conn, seq, link);
+        start_timer(conn, conn->window[seq % WINDOW_SIZE], link);
+        return;
+    }
+    retransmit_window(conn, link);
+}
+
+//  WHILE A PATH TO A HOST IS DOWN, SEND THE OLDEST FRAME WAITING FOR ITS ACK DOWN THAT PATH AS WELL.
+//  THE RECEIVER ACKS IT BACK THE WAY IT CAME, SO THE ACK BRINGS THE PATH BACK UP
+EVENT_HANDLER(probe_paths)
+{
+    PEER    *peer = PEER_lookup((CnetAddr)data);
+    SWCONN  *conn = SWCONN_lookup((CnetAddr)data);
+    int     down = 0;
+
+    if (peer == NULL){
+        return;
+    }
+    peer->probetimer = NULLTIMER;
+    for (int link = 1; link <= nodeinfo.nlinks; link++){
+        if (!peer->path[link].down){
+            continue;
+        }
+        down++;
+        if (conn != NULL && conn->nbuffered > 0){
+            int slot = conn->ackexpected % WINDOW_SIZE;
+
+            // a copy, the frame is still waiting on the path it went out on
+            transmit_data(conn->window[slot], link, TR_RESEND);
+            METRICS_count(M_RETRANSMIT);
+            conn->retransmitted[slot] = 1;
+            conn->epochwire += FRAME_SIZE((*conn->window[slot]));
+        }
+    }
+    if (down > 0){
+        peer->probetimer = CNET_start_timer(EV_TIMER3, PROBE_INTERVAL, data);
+    }
+}
+
+//  NO DATA FRAME HAS GONE BACK TO THE HOST IN TIME, SO ITS ACK GOES ON ITS OWN
+EVENT_HANDLER(ack_timeout)
+{
+    PEER    *peer = PEER_lookup((CnetAddr)data);
 
-    lastframe = swconn.lastframe;
-    transmit_frame(nodeinfo.address, lastframe.dest, &lastframe.msg, lastframe.len, lastframe.seq, ackno, 1, 0);
+    if (peer != NULL){
+        peer->acktimer = NULLTIMER;
+        send_ack(peer, -1);
+    }
 }
 
 //  DISPLAY THE CURRENT SEQUENCE NUMBERS WHEN A BUTTON IS PRESSED
 EVENT_HANDLER(showstate)
 {
+    SWCONN      **conn;
+    ROUTE       *route;
+    PEER        **peer;
+    CnetAddr    addr;
+    int         slot;
+
     printf("------------------------\n");
+    printf("Windows:  %s\n", ARQ_MODE == ARQ_SELECTIVE_REPEAT ? "selective-repeat" : "go-back-n");
+    slot = 0;
+    while ((conn = ADDRTABLE_next(&connections, &slot, NULL)) != NULL){
+        printf("HOST[%d] ACKEXPECTED[%d] NEXTFRAMETOSEND[%d] NBUFFERED[%d/%d]\n",
+            (*conn)->dest, (*conn)->ackexpected, (*conn)->nextframetosend, (*conn)->nbuffered, WINDOW_SIZE);
+    }
     printf("Shortest path table:  \n");
-    for (int i = 0; i < 14; i++){
-        if (swconn.host_list[i] != -1){
-            printf("HOST[%d] TRANSLINK[%d] HOP_COUNT[%d]\n", swconn.host_list[i], swconn.found_shortest_path[i], swconn.host_hop_count[i]);
+    slot = 0;
+    while ((route = ADDRTABLE_next(&routes, &slot, &addr)) != NULL){
+        printf("HOST[%d] TRANSLINK[%d] HOP_COUNT[%d]\n", addr, route->link, route->hops);
+    }
+    if (FEC_M > 0){
+        printf("FEC:  %d parity frames for every %d data frames\n", FEC_M, FEC_K);
+    }
+    printf("Compression:  %s\n", compress_name());
+    printf("Paths:  %s\n", MULTIPATH ? "striped" : "shortest");
+    slot = 0;
+    while ((peer = ADDRTABLE_next(&peers, &slot, NULL)) != NULL){
+        for (int link = 1; link <= nodeinfo.nlinks; link++){
+            PATH *path = &(*peer)->path[link];
+
+            printf("HOST[%d] LINK[%d] SRTT[%ldus] RTTVAR[%ldus] HOPS[%d] BACKOFF[%d] LOSS[%.2f]%s\n", (*peer)->addr, link,
+                (long)path->srtt, (long)path->rttvar, path->hops, path->backoff, path->loss, path->down ? " DOWN" : "");
         }
     }
+    LINKQUEUE_show();
+    FRAMEPOOL_show();
+    METRICS_show();
     printf("------------------------\n");
 }
 
+//  AT THE END OF THE SIMULATION, LEAVE THE METRICS IN THE OUTPUT AND THE TRACE IN A FILE
+EVENT_HANDLER(shutdown_node)
+{
+    METRICS_dump();
+    TRACE_dump();
+}
+
 //  THIS FUNCTION IS CALLED ONCE, AT THE BEGINNING OF THE WHOLE SIMULATION
 EVENT_HANDLER(reboot_node)
 {
@@ -304,14 +1808,23 @@ EVENT_HANDLER(reboot_node)
     }
     CHECK(CNET_set_handler( EV_PHYSICALREADY,    physical_ready, 0));
     CHECK(CNET_set_handler( EV_TIMER1,           timeouts, 0));
+    CHECK(CNET_set_handler( EV_TIMER2,           ack_timeout, 0));
+    CHECK(CNET_set_handler( EV_TIMER3,           probe_paths, 0));
+    CHECK(CNET_set_handler( EV_SHUTDOWN,         shutdown_node, 0));
 
 //  BIND A FUNCTION AND A LABEL TO ONE OF THE NODE'S BUTTONS
     CHECK(CNET_set_handler( EV_DEBUG0,           showstate, 0));
     CHECK(CNET_set_debug_string( EV_DEBUG0, "State"));
 
-    if(nodeinfo.nodenumber == 0)
-	CNET_enable_application(ALLNODES);
+    if (ALL_SENDERS || nodeinfo.nodenumber == 0){
+        CNET_enable_application(ALLNODES);
+    }
 
-    // init SWCONN
-    SWCONN_init();
+    ADDRTABLE_init(&connections, sizeof(SWCONN *));
+    FRAMEPOOL_init(sizeof(FRAME));
+    LINKQUEUE_init();
+    METRICS_init();
+    TRACE_init();
+    ADDRTABLE_init(&routes, sizeof(ROUTE));
+    ADDRTABLE_init(&peers, sizeof(PEER *));
 }
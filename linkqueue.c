@@ -0,0 +1,205 @@
+#include <cnet.h>
+#include <stdlib.h>
+
+#include "framepool.h"
+#include "linkqueue.h"
+#include "trace.h"
+
+/*  A transmit queue for each link, see linkqueue.h.
+
+    Each queue is a list of references to frame buffers, so queueing a
+    frame never copies it. The average queue that RED works from is a moving average of the
+    bytes waiting, taken as each frame arrives, with weight 1/LQ_RED_WEIGHT.
+ */
+
+#define LQ_RED_WEIGHT       8
+
+typedef struct _QFRAME {
+    struct _QFRAME  *next;
+    size_t          len;
+    void            *frame;     // a reference from FRAMEPOOL_hold()
+} QFRAME;
+
+typedef struct {
+    QFRAME      *head, *tail;
+    int         busy;       // 1 while the link is sending a frame
+    size_t      bytes;      // waiting, not counting the frame being sent
+    int         frames;
+    double      avg;        // RED: the average of bytes
+    int         count;      // RED: frames queued since the last random drop
+    // statistics
+    long        sent;
+    long        queued;
+    long        droptail;
+    long        dropred;
+    size_t      maxbytes;
+    int         maxframes;
+    double      sumbytes;   // of bytes as each frame arrived, for the mean depth
+    long        arrivals;
+} LINKQUEUE;
+
+static  LINKQUEUE   *queues     = NULL;     // nodeinfo.nlinks + 1 of them, link 0 unused
+static  int         nqueues     = 0;
+
+
+//  1 IF RED DECIDES TO DROP THE FRAME ARRIVING AT q
+static int red_drop(LINKQUEUE *q)
+{
+    double  pb, pa;
+
+    q->avg += ((double)q->bytes - q->avg) / LQ_RED_WEIGHT;
+    if (q->avg < LQ_RED_MIN){
+        q->count = 0;
+        return 0;
+    }
+    if (q->avg >= LQ_RED_MAX){
+        q->count = 0;
+        return 1;
+    }
+    // spread the drops out evenly rather than in clumps
+    pb = (LQ_RED_MAXP / 100.0) * (q->avg - LQ_RED_MIN) / (LQ_RED_MAX - LQ_RED_MIN);
+    pa = (q->count * pb < 1.0) ? pb / (1.0 - q->count * pb) : 1.0;
+    if (rand() / (RAND_MAX + 1.0) < pa){
+        q->count = 0;
+        return 1;
+    }
+    q->count++;
+    return 0;
+}
+
+//  SEND THE FRAME AT THE HEAD OF THE QUEUE IF THE LINK IS IDLE. IF THE LINK WON'T TAKE IT,
+//  IT STAYS AT THE HEAD UNTIL THE NEXT EV_LINKREADY OR THE NEXT FRAME FOR THE LINK
+static void kick(LINKQUEUE *q, int link)
+{
+    QFRAME      *qf = q->head;
+    size_t      len;
+
+    if (q->busy || qf == NULL){
+        return;
+    }
+    len = qf->len;
+    if (CNET_write_physical(link, qf->frame, &len) != 0){
+        return;
+    }
+    q->busy = 1;
+    q->sent++;
+    q->head = qf->next;
+    if (q->head == NULL){
+        q->tail = NULL;
+    }
+    q->bytes -= qf->len;
+    q->frames--;
+    FRAMEPOOL_release(qf->frame);
+    free(qf);
+}
+
+static EVENT_HANDLER(link_ready)
+{
+    int         link = (int)data;
+
+    if (link >= 1 && link < nqueues){
+        queues[link].busy = 0;
+        kick(&queues[link], link);
+    }
+}
+
+void LINKQUEUE_init(void)
+{
+    for (int link = 1; link < nqueues; link++){
+        while (queues[link].head != NULL){
+            QFRAME *qf = queues[link].head;
+
+            queues[link].head = qf->next;
+            FRAMEPOOL_release(qf->frame);
+            free(qf);
+        }
+    }
+    free(queues);
+    nqueues = nodeinfo.nlinks + 1;
+    queues = calloc(nqueues, sizeof(LINKQUEUE));
+    if (queues == NULL){
+        nqueues = 0;
+    }
+    CHECK(CNET_set_handler(EV_LINKREADY, link_ready, 0));
+}
+
+int LINKQUEUE_write(int link, void *frame, size_t len)
+{
+    LINKQUEUE   *q;
+    QFRAME      *qf;
+
+    if (link < 1 || link >= nqueues){
+        // the loopback link, or no queues to be had
+        return CNET_write_physical(link, frame, &len) == 0 ? 0 : -1;
+    }
+    q = &queues[link];
+    q->arrivals++;
+    q->sumbytes += q->bytes;
+
+    if (!q->busy && q->head == NULL){
+        size_t n = len;
+
+        if (CNET_write_physical(link, frame, &n) == 0){
+            q->busy = 1;
+            q->sent++;
+            return 0;
+        }
+    }
+    if (q->bytes + len > LQ_BUDGET){
+        q->droptail++;
+        LOG(LOG_INFO, "queue for link %d full, frame dropped\n", link);
+        TRACE(TR_DROP, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+        return -1;
+    }
+    if (LQ_POLICY == LQ_RED && red_drop(q)){
+        q->dropred++;
+        LOG(LOG_INFO, "queue for link %d congested, frame dropped\n", link);
+        TRACE(TR_DROP, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+        return -1;
+    }
+    qf = malloc(sizeof(QFRAME));
+    if (qf == NULL){
+        q->droptail++;
+        LOG(LOG_ERROR, "out of memory, frame for link %d dropped\n", link);
+        TRACE(TR_DROP, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+        return -1;
+    }
+    qf->next = NULL;
+    qf->len = len;
+    qf->frame = FRAMEPOOL_hold(frame);
+    if (q->tail == NULL){
+        q->head = qf;
+    }
+    else {
+        q->tail->next = qf;
+    }
+    q->tail = qf;
+    q->bytes += len;
+    q->frames++;
+    q->queued++;
+    if (q->bytes > q->maxbytes){
+        q->maxbytes = q->bytes;
+    }
+    if (q->frames > q->maxframes){
+        q->maxframes = q->frames;
+    }
+    kick(q, link);
+    return 0;
+}
+
+size_t LINKQUEUE_bytes(int link)
+{
+    return (link >= 1 && link < nqueues) ? queues[link].bytes : 0;
+}
+
+void LINKQUEUE_show(void)
+{
+    printf("Link queues:  %s, %d bytes each\n", LQ_POLICY == LQ_RED ? "red" : "drop-tail", LQ_BUDGET);
+    for (int link = 1; link < nqueues; link++){
+        LINKQUEUE *q = &queues[link];
+
+        printf("LINK[%d] NOW[%d frames, %lu bytes] MAX[%d frames, %lu bytes] MEAN[%.0f bytes] SENT[%ld] QUEUED[%ld] DROPPED[%ld tail, %ld red]\n",
+            link, q->frames, (unsigned long)q->bytes, q->maxframes, (unsigned long)q->maxbytes,
+            q->arrivals ? q->sumbytes / q->arrivals : 0.0, q->sent, q->queued, q->droptail, q->dropred);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _LINKQUEUE_H
+#define _LINKQUEUE_H
+
+#include <cnet.h>
+#include <stddef.h>
+
+/*  A transmit queue for each link.
+
+    A link can only send one frame at a time, so a frame written while the
+    link is still sending the last one waits in the link's queue, and goes
+    when cnet raises EV_LINKREADY for the link. Each queue holds at most
+    LQ_BUDGET bytes. When a frame does not fit it is dropped, and which
+    frame is dropped depends on LQ_POLICY, chosen when the protocol is
+    built, e.g. with -DLQ_POLICY=LQ_RED in CNETCFLAGS:
+
+    LQ_DROPTAIL   the default, the frame that does not fit is dropped.
+    LQ_RED        Random Early Detection (Floyd and Jacobson), frames are
+                  dropped at random once the average queue passes
+                  LQ_RED_MIN, more often as it nears LQ_RED_MAX, so that
+                  senders back off before the queue is full.
+
+    Frames are written from buffers taken from the frame pool (framepool.h).
+    A frame that has to wait is not copied, the queue holds a reference to
+    its buffer until the frame is sent, so the writer may release its own
+    reference as soon as LINKQUEUE_write() returns.
+
+    The module takes over EV_LINKREADY, so the protocol must leave it alone.
+ */
+
+#define LQ_DROPTAIL         0
+#define LQ_RED              1
+
+#ifndef LQ_POLICY
+#define LQ_POLICY           LQ_DROPTAIL
+#endif
+
+//  THE MOST BYTES THAT MAY WAIT FOR EACH LINK
+#ifndef LQ_BUDGET
+#define LQ_BUDGET           (16 * MAX_MESSAGE_SIZE)
+#endif
+
+//  RED: THE AVERAGE QUEUE IN BYTES WHERE DROPPING STARTS, AND WHERE EVERY FRAME IS DROPPED,
+//  AND THE CHANCE OF A DROP JUST BELOW LQ_RED_MAX, IN PERCENT
+#ifndef LQ_RED_MIN
+#define LQ_RED_MIN          (LQ_BUDGET / 4)
+#endif
+#ifndef LQ_RED_MAX
+#define LQ_RED_MAX          (3 * LQ_BUDGET / 4)
+#endif
+#ifndef LQ_RED_MAXP
+#define LQ_RED_MAXP         10
+#endif
+
+//  PREPARE AN EMPTY QUEUE FOR EACH LINK
+extern  void    LINKQUEUE_init(void);
+
+//  SEND A FRAME ON link NOW IF THE LINK IS IDLE, ELSE QUEUE IT, RETURN -1 IF IT WAS DROPPED.
+//  frame MUST BE A BUFFER FROM FRAMEPOOL_alloc()
+extern  int     LINKQUEUE_write(int link, void *frame, size_t len);
+
+//  THE NUMBER OF BYTES WAITING FOR link
+extern  size_t  LINKQUEUE_bytes(int link);
+
+//  PRINT THE DEPTH AND DROPS OF EACH QUEUE
+extern  void    LINKQUEUE_show(void);
+
+#endif
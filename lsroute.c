@@ -0,0 +1,479 @@
+#include <cnet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addrtable.h"
+#include "lsroute.h"
+#include "trace.h"
+
+/*  Link-state routing, see lsroute.h.
+
+    The shortest path tree is kept from one LSA to the next rather than
+    being worked out afresh each time. When an LSA arrives, a link that got
+    cheaper or is new can only shorten paths, so Dijkstra's algorithm is
+    carried on from the far end of that link alone. A link that got dearer
+    or went away changes nothing unless the tree uses it, and only then, or
+    when our own links change, is the whole tree computed again.
+ */
+
+//  THE KINDS OF MESSAGE, THE FIRST BYTE OF EACH
+#define LS_HELLO            1       // 4 byte address of the sender
+#define LS_LSA              2       // 4 byte origin, 4 byte sequence number, 2 byte count,
+                                    // then count neighbours, a 4 byte address and 4 byte cost each
+
+#define LS_UNREACHABLE      INT64_MAX
+
+typedef struct {
+    CnetAddr    addr;
+    uint32_t    cost;       // in usecs
+    int         link;       // the link it is on, only known for our own neighbours
+} LSEDGE;
+
+typedef struct {
+    uint32_t    seq;        // of the newest LSA from this node, 0 if none has arrived
+    CnetTime    received;   // when it arrived
+    int         nedges;
+    LSEDGE      *edges;
+    CnetTime    dist;       // the cost of the shortest path here, or LS_UNREACHABLE
+    CnetAddr    parent;     // the node before this one on that path
+    int         link;       // the link that path leaves us on
+} LSNODE;
+
+typedef struct {
+    CnetTime    dist;
+    CnetAddr    addr;
+} HEAPENTRY;
+
+static  ADDRTABLE       lsdb;
+static  LSROUTE_SEND    send_msg;
+
+//  THE NODE AT THE OTHER END OF EACH LINK, IF WE HAVE HEARD FROM IT
+static  struct {
+    int         up;
+    CnetAddr    addr;
+    CnetTime    heard;
+} neighbours[LS_MAX_LINKS + 1];
+
+static  uint32_t        myseq           = 0;
+static  CnetTime        originated      = 0;
+
+//  THE NODES WHOSE PATHS HAVE GOT SHORTER, NEAREST FIRST. A NODE MAY BE IN
+//  IT MORE THAN ONCE, ONLY THE ENTRY MATCHING ITS CURRENT dist COUNTS
+static  HEAPENTRY       *heap           = NULL;
+static  int             heapsize        = 0;
+static  int             heapcapacity    = 0;
+
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//  THE TIME TO DELIVER THE LARGEST MESSAGE OVER link
+static uint32_t link_cost(int link)
+{
+    CnetTime    cost = linkinfo[link].propagationdelay +
+                       (CnetTime)nodeinfo.maxmessagesize * 8000000 / linkinfo[link].bandwidth;
+
+    return (cost < UINT32_MAX) ? (uint32_t)cost : UINT32_MAX;
+}
+
+static void heap_push(CnetTime dist, CnetAddr addr)
+{
+    int     i;
+
+    if (heapsize == heapcapacity){
+        int         newcapacity = heapcapacity ? 2 * heapcapacity : 64;
+        HEAPENTRY   *bigger = realloc(heap, newcapacity * sizeof(HEAPENTRY));
+
+        if (bigger == NULL){
+            LOG(LOG_ERROR, "out of memory, shortest paths may be wrong\n");
+            return;
+        }
+        heap = bigger;
+        heapcapacity = newcapacity;
+    }
+    for (i = heapsize++; i > 0 && heap[(i - 1) / 2].dist > dist; i = (i - 1) / 2){
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i].dist = dist;
+    heap[i].addr = addr;
+}
+
+static int heap_pop(HEAPENTRY *top)
+{
+    HEAPENTRY   last;
+    int         i = 0;
+
+    if (heapsize == 0){
+        return 0;
+    }
+    *top = heap[0];
+    last = heap[--heapsize];
+    for (;;){
+        int child = 2 * i + 1;
+
+        if (child >= heapsize){
+            break;
+        }
+        if (child + 1 < heapsize && heap[child + 1].dist < heap[child].dist){
+            child++;
+        }
+        if (heap[child].dist >= last.dist){
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return 1;
+}
+
+//  ADD AN ENTRY FOR A NODE WE HAVE NO LSA FROM, RETURN 0 ON SUCCESS
+static int new_node(CnetAddr addr)
+{
+    LSNODE  *n = ADDRTABLE_insert(&lsdb, addr);
+
+    if (n == NULL){
+        LOG(LOG_ERROR, "out of memory, node %d ignored\n", addr);
+        return -1;
+    }
+    n->dist = LS_UNREACHABLE;
+    n->parent = -1;
+    n->link = -1;
+    return 0;
+}
+
+//  SHORTEN THE PATH TO THE FAR END OF e IF GOING THROUGH u, AT addr, IS SHORTER
+static void relax(LSNODE *u, CnetAddr addr, LSEDGE *e)
+{
+    LSNODE      *v = ADDRTABLE_find(&lsdb, e->addr);
+    CnetTime    dist = u->dist + e->cost;
+
+    if (v != NULL && dist < v->dist){
+        v->dist = dist;
+        v->parent = addr;
+        v->link = (addr == nodeinfo.address) ? e->link : u->link;
+        heap_push(dist, e->addr);
+    }
+}
+
+//  CARRY ON DIJKSTRA'S ALGORITHM UNTIL NO PATH CAN GET ANY SHORTER
+static void spf_run(void)
+{
+    HEAPENTRY   top;
+
+    while (heap_pop(&top)){
+        LSNODE  *u = ADDRTABLE_find(&lsdb, top.addr);
+
+        if (u == NULL || u->dist != top.dist){
+            continue;       // the path here got shorter again after this entry was pushed
+        }
+        for (int i = 0; i < u->nedges; i++){
+            relax(u, top.addr, &u->edges[i]);
+        }
+    }
+}
+
+//  WORK OUT EVERY SHORTEST PATH FROM SCRATCH
+static void spf_full(void)
+{
+    LSNODE      *n;
+    CnetAddr    addr;
+    int         slot = 0;
+
+    while ((n = ADDRTABLE_next(&lsdb, &slot, &addr)) != NULL){
+        n->dist = LS_UNREACHABLE;
+        n->parent = -1;
+        n->link = -1;
+    }
+    n = ADDRTABLE_find(&lsdb, nodeinfo.address);
+    if (n == NULL){
+        return;
+    }
+    n->dist = 0;
+    n->parent = nodeinfo.address;
+    n->link = 0;
+    heapsize = 0;
+    heap_push(0, nodeinfo.address);
+    spf_run();
+}
+
+//  REPLACE THE NEIGHBOURS origin HAS, AND FIX THE SHORTEST PATHS THAT CHANGES
+static void install(CnetAddr origin, uint32_t seq, const LSEDGE *edges, int nedges)
+{
+    LSEDGE      *copy = NULL;
+    LSNODE      *node;
+    int         full;
+
+    if (nedges > 0){
+        copy = malloc(nedges * sizeof(LSEDGE));
+        if (copy == NULL){
+            LOG(LOG_ERROR, "out of memory, LSA from %d dropped\n", origin);
+            return;
+        }
+        memcpy(copy, edges, nedges * sizeof(LSEDGE));
+    }
+
+    // every node named needs an entry before we take pointers into the table
+    if (ADDRTABLE_find(&lsdb, origin) == NULL && new_node(origin) != 0){
+        free(copy);
+        return;
+    }
+    for (int i = 0; i < nedges; i++){
+        if (ADDRTABLE_find(&lsdb, edges[i].addr) == NULL){
+            new_node(edges[i].addr);
+        }
+    }
+    node = ADDRTABLE_find(&lsdb, origin);
+
+    // a link that got dearer or went only matters if the tree uses it
+    full = (origin == nodeinfo.address);
+    for (int i = 0; !full && node->dist != LS_UNREACHABLE && i < node->nedges; i++){
+        LSEDGE  *old = &node->edges[i];
+        LSNODE  *child = ADDRTABLE_find(&lsdb, old->addr);
+        int     kept = 0;
+
+        if (child == NULL || child->parent != origin){
+            continue;
+        }
+        for (int j = 0; j < nedges; j++){
+            if (edges[j].addr == old->addr && edges[j].cost <= old->cost){
+                kept = 1;
+                break;
+            }
+        }
+        full = !kept;
+    }
+
+    free(node->edges);
+    node->edges = copy;
+    node->nedges = nedges;
+    node->seq = seq;
+    node->received = nodeinfo.time_in_usec;
+
+    if (full){
+        spf_full();
+    }
+    else if (node->dist != LS_UNREACHABLE){
+        // links that got cheaper or are new can only shorten paths, start from their far ends
+        heapsize = 0;
+        for (int i = 0; i < nedges; i++){
+            relax(node, origin, &node->edges[i]);
+        }
+        spf_run();
+    }
+}
+
+//  SEND THE LSA WE HOLD FROM origin ON link
+static void send_lsa(int link, CnetAddr origin)
+{
+    unsigned char   msg[LS_MAX_MESSAGE];
+    LSNODE          *n = ADDRTABLE_find(&lsdb, origin);
+    size_t          len = 11;
+
+    if (n == NULL || n->seq == 0 || n->nedges > LS_MAX_LINKS){
+        return;
+    }
+    msg[0] = LS_LSA;
+    put32(&msg[1], origin);
+    put32(&msg[5], n->seq);
+    msg[9] = (n->nedges >> 8) & 0xff;
+    msg[10] = n->nedges & 0xff;
+    for (int i = 0; i < n->nedges; i++){
+        put32(&msg[len], n->edges[i].addr);
+        put32(&msg[len + 4], n->edges[i].cost);
+        len += 8;
+    }
+    send_msg(link, msg, len);
+}
+
+//  SEND THE LSA FROM origin ON EVERY LINK BUT except
+static void flood(CnetAddr origin, int except)
+{
+    for (int link = 1; link <= nodeinfo.nlinks && link <= LS_MAX_LINKS; link++){
+        if (link != except){
+            send_lsa(link, origin);
+        }
+    }
+}
+
+//  DESCRIBE OUR NEIGHBOURS IN A NEW LSA AND FLOOD IT
+static void originate(void)
+{
+    LSEDGE  edges[LS_MAX_LINKS];
+    int     nedges = 0;
+
+    for (int link = 1; link <= nodeinfo.nlinks && link <= LS_MAX_LINKS; link++){
+        if (neighbours[link].up){
+            edges[nedges].addr = neighbours[link].addr;
+            edges[nedges].cost = link_cost(link);
+            edges[nedges].link = link;
+            nedges++;
+        }
+    }
+    originated = nodeinfo.time_in_usec;
+    install(nodeinfo.address, ++myseq, edges, nedges);
+    flood(nodeinfo.address, 0);
+}
+
+static void send_hello(int link)
+{
+    unsigned char   msg[5];
+
+    msg[0] = LS_HELLO;
+    put32(&msg[1], nodeinfo.address);
+    send_msg(link, msg, sizeof(msg));
+}
+
+static EVENT_HANDLER(lsroute_timeout)
+{
+    CnetTime    now = nodeinfo.time_in_usec;
+    int         changed = 0;
+    LSNODE      *n;
+    CnetAddr    addr;
+    int         slot = 0;
+
+    for (int link = 1; link <= nodeinfo.nlinks && link <= LS_MAX_LINKS; link++){
+        send_hello(link);
+        if (neighbours[link].up && now - neighbours[link].heard >= LS_DEAD_INTERVAL){
+            LOG(LOG_INFO, "neighbour %d on link %d is down\n", neighbours[link].addr, link);
+            neighbours[link].up = 0;
+            changed = 1;
+        }
+    }
+
+    // forget what old LSAs said, but keep their sequence numbers so that no older copy is believed
+    while ((n = ADDRTABLE_next(&lsdb, &slot, &addr)) != NULL){
+        if (addr != nodeinfo.address && n->nedges > 0 && now - n->received >= LS_MAX_AGE){
+            install(addr, n->seq, NULL, 0);
+        }
+    }
+
+    if (changed || now - originated >= LS_REFRESH){
+        originate();
+    }
+    CNET_start_timer(LS_TIMER, LS_HELLO_PERIOD, 0);
+}
+
+void LSROUTE_init(LSROUTE_SEND send)
+{
+    LSNODE      *n;
+    int         slot = 0;
+
+    while ((n = ADDRTABLE_next(&lsdb, &slot, NULL)) != NULL){
+        free(n->edges);
+    }
+    ADDRTABLE_free(&lsdb);
+    ADDRTABLE_init(&lsdb, sizeof(LSNODE));
+    memset(neighbours, 0, sizeof(neighbours));
+    send_msg = send;
+    myseq = 0;
+    heapsize = 0;
+
+    CHECK(CNET_set_handler(LS_TIMER, lsroute_timeout, 0));
+    CNET_start_timer(LS_TIMER, LS_HELLO_PERIOD, 0);
+    originate();
+    for (int link = 1; link <= nodeinfo.nlinks && link <= LS_MAX_LINKS; link++){
+        send_hello(link);
+    }
+}
+
+void LSROUTE_receive(int link, const unsigned char *msg, size_t len)
+{
+    if (link < 1 || link > LS_MAX_LINKS || len < 5){
+        return;
+    }
+    if (msg[0] == LS_HELLO){
+        CnetAddr    addr = (CnetAddr)get32(&msg[1]);
+        int         isnew = !neighbours[link].up || neighbours[link].addr != addr;
+
+        neighbours[link].up = 1;
+        neighbours[link].addr = addr;
+        neighbours[link].heard = nodeinfo.time_in_usec;
+        if (isnew){
+            LSNODE      *n;
+            CnetAddr    origin;
+            int         slot = 0;
+
+            LOG(LOG_INFO, "neighbour %d on link %d is up\n", addr, link);
+            originate();
+            // bring the new neighbour up to date with everything we know
+            while ((n = ADDRTABLE_next(&lsdb, &slot, &origin)) != NULL){
+                if (origin != nodeinfo.address){
+                    send_lsa(link, origin);
+                }
+            }
+        }
+    }
+    else if (msg[0] == LS_LSA && len >= 11){
+        CnetAddr    origin = (CnetAddr)get32(&msg[1]);
+        uint32_t    seq = get32(&msg[5]);
+        int         nedges = (msg[9] << 8) | msg[10];
+        LSEDGE      edges[LS_MAX_LINKS];
+        LSNODE      *n;
+
+        if (nedges > LS_MAX_LINKS || len < 11 + (size_t)nedges * 8){
+            return;
+        }
+        if (origin == nodeinfo.address){
+            // an LSA of ours from before we rebooted, outdo it
+            if (seq > myseq){
+                myseq = seq;
+                originate();
+            }
+            return;
+        }
+        n = ADDRTABLE_find(&lsdb, origin);
+        if (n != NULL && n->seq >= seq){
+            return;         // seen it already
+        }
+        for (int i = 0; i < nedges; i++){
+            edges[i].addr = (CnetAddr)get32(&msg[11 + i * 8]);
+            edges[i].cost = get32(&msg[15 + i * 8]);
+            edges[i].link = 0;
+        }
+        install(origin, seq, edges, nedges);
+        flood(origin, link);
+    }
+}
+
+int LSROUTE_link(CnetAddr dest)
+{
+    LSNODE      *n = ADDRTABLE_find(&lsdb, dest);
+
+    return (n == NULL || n->dist == LS_UNREACHABLE) ? -1 : n->link;
+}
+
+CnetTime LSROUTE_cost(CnetAddr dest)
+{
+    LSNODE      *n = ADDRTABLE_find(&lsdb, dest);
+
+    return (n == NULL || n->dist == LS_UNREACHABLE) ? -1 : n->dist;
+}
+
+void LSROUTE_show(void)
+{
+    LSNODE      *n;
+    CnetAddr    addr;
+    int         slot = 0;
+
+    printf("\n\tdest\tlink\tcost(ms)\n");
+    while ((n = ADDRTABLE_next(&lsdb, &slot, &addr)) != NULL){
+        if (n->dist != LS_UNREACHABLE){
+            printf("\t%d\t%d\t%lld\n", addr, n->link, (long long)(n->dist / 1000));
+        }
+        else {
+            printf("\t%d\t-\tunreachable\n", addr);
+        }
+    }
+}
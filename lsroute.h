@@ -0,0 +1,72 @@
+#ifndef _LSROUTE_H
+#define _LSROUTE_H
+
+#include <cnet.h>
+#include <stddef.h>
+
+/*  Link-state routing, run by every host and router.
+
+    Each node finds out who is at the other end of each of its links by
+    sending a hello on it every LS_HELLO_PERIOD usecs, and describes its
+    neighbours in a link-state advertisement (LSA). LSAs are flooded to
+    every node, so each builds the same picture of the whole network, and
+    each then finds its shortest paths with Dijkstra's algorithm.
+
+    A link costs the time in usecs to deliver the largest message over it,
+    its propagation delay plus the time to clock the bits out, so routes
+    prefer a fast link to a slow one rather than simply taking fewer hops.
+
+    Each LSA has a sequence number, so a node keeps only the newest one
+    from each origin and floods only LSAs it has not seen before. A node
+    sends its LSA again when a neighbour comes or goes, and at least every
+    LS_REFRESH usecs. LSAs not heard again for LS_MAX_AGE usecs are dropped.
+
+    As with dvroute.c, the protocol sends and receives the messages, in
+    whatever frames it likes, through the function given to LSROUTE_init()
+    and through LSROUTE_receive().
+ */
+
+//  HOW OFTEN HELLOS ARE SENT, AND HOW LONG A SILENT NEIGHBOUR LASTS, IN MICROSECONDS
+#ifndef LS_HELLO_PERIOD
+#define LS_HELLO_PERIOD     5000000
+#endif
+#ifndef LS_DEAD_INTERVAL
+#define LS_DEAD_INTERVAL    (3 * LS_HELLO_PERIOD)
+#endif
+
+//  HOW OFTEN A NODE RESENDS ITS LSA, AND HOW LONG AN LSA LASTS WITHOUT BEING SENT AGAIN
+#ifndef LS_REFRESH
+#define LS_REFRESH          30000000
+#endif
+#ifndef LS_MAX_AGE
+#define LS_MAX_AGE          (3 * LS_REFRESH)
+#endif
+
+//  THE TIMER EVENT THE MODULE USES, WHICH THE PROTOCOL MUST LEAVE ALONE
+#ifndef LS_TIMER
+#define LS_TIMER            EV_TIMER4
+#endif
+
+//  THE LONGEST MESSAGE THE MODULE SENDS, AN LSA FOR A NODE WITH LS_MAX_LINKS NEIGHBOURS
+#define LS_MAX_LINKS        64
+#define LS_MAX_MESSAGE      (11 + LS_MAX_LINKS * 8)
+
+//  SENDS len BYTES OF MESSAGE TO THE NEIGHBOUR ON link
+typedef void    (*LSROUTE_SEND)(int link, const unsigned char *msg, size_t len);
+
+//  START WITH NO NEIGHBOURS, AND SAY HELLO ON EVERY LINK
+extern  void    LSROUTE_init(LSROUTE_SEND send);
+
+//  TAKE IN A MESSAGE THAT ARRIVED ON link
+extern  void    LSROUTE_receive(int link, const unsigned char *msg, size_t len);
+
+//  THE LINK TO FORWARD A FRAME FOR dest ON, 0 FOR THIS NODE, -1 IF dest IS UNREACHABLE
+extern  int     LSROUTE_link(CnetAddr dest);
+
+//  THE COST OF THE SHORTEST PATH TO dest IN MICROSECONDS, -1 IF dest IS UNREACHABLE
+extern  CnetTime LSROUTE_cost(CnetAddr dest);
+
+//  PRINT THE ROUTING TABLE
+extern  void    LSROUTE_show(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+/*  Counters and latency histograms for one node, see metrics.h.
+
+    A sample of n usecs goes in bucket b, the number of bits in n, so
+    bucket 0 holds 0, bucket 1 holds 1, bucket 2 holds 2 and 3, and so on.
+    A percentile is reported as the top of the bucket it falls in, which
+    is never more than twice the true value.
+ */
+
+typedef struct {
+    long        buckets[METRICS_BUCKETS];
+    long        n;
+    CnetTime    sum;
+    CnetTime    max;
+} HIST;
+
+static  const char  *metric_names[N_METRICS] = {
+    "sent", "forwarded", "received", "delivered",
+    "badchecksum", "duplicate", "retransmit", "timeout", "rebuilt", "compressed", "acks",
+};
+static  const char  *hist_names[N_HISTOGRAMS] = { "rtt", "acked" };
+
+long        metrics[N_METRICS];
+LINKMETRICS *metrics_link   = NULL;
+int         metrics_nlinks  = 0;
+
+static  HIST        hists[N_HISTOGRAMS];
+
+
+void METRICS_init(void)
+{
+    free(metrics_link);
+    metrics_link = calloc(nodeinfo.nlinks + 1, sizeof(LINKMETRICS));
+    metrics_nlinks = (metrics_link == NULL) ? 0 : nodeinfo.nlinks;
+    memset(metrics, 0, sizeof(metrics));
+    memset(hists, 0, sizeof(hists));
+}
+
+void METRICS_sample(HISTOGRAM h, CnetTime usec)
+{
+    HIST    *hp = &hists[h];
+    int     b = 0;
+
+    if (usec < 0){
+        usec = 0;
+    }
+    for (CnetTime v = usec; v != 0 && b < METRICS_BUCKETS - 1; v >>= 1){
+        b++;
+    }
+    hp->buckets[b]++;
+    hp->n++;
+    hp->sum += usec;
+    if (usec > hp->max){
+        hp->max = usec;
+    }
+}
+
+//  THE TOP OF THE BUCKET HOLDING THE pct PERCENTILE OF A HISTOGRAM, 0 IF IT IS EMPTY
+static CnetTime percentile(HIST *hp, int pct)
+{
+    long    want = (hp->n * pct + 99) / 100;
+    long    seen = 0;
+
+    for (int b = 0; b < METRICS_BUCKETS; b++){
+        seen += hp->buckets[b];
+        if (seen >= want && seen > 0){
+            return (b == METRICS_BUCKETS - 1) ? hp->max : ((CnetTime)1 << b) - 1;
+        }
+    }
+    return 0;
+}
+
+void METRICS_show(void)
+{
+    printf("Metrics:  ");
+    for (int m = 0; m < N_METRICS; m++){
+        printf("%s[%ld] ", metric_names[m], metrics[m]);
+    }
+    printf("\n");
+    for (int link = 1; link <= metrics_nlinks; link++){
+        LINKMETRICS *l = &metrics_link[link];
+
+        printf("LINK[%d] TX[%ld frames, %ld bytes] RX[%ld frames, %ld bytes]\n",
+            link, l->txframes, l->txbytes, l->rxframes, l->rxbytes);
+    }
+    for (int h = 0; h < N_HISTOGRAMS; h++){
+        HIST *hp = &hists[h];
+
+        printf("%s:  n[%ld] mean[%ldus] p50[<%ldus] p99[<%ldus] max[%ldus]\n", hist_names[h], hp->n,
+            hp->n ? (long)(hp->sum / hp->n) : 0L, (long)percentile(hp, 50), (long)percentile(hp, 99), (long)hp->max);
+        for (int b = 0; b < METRICS_BUCKETS; b++){
+            if (hp->buckets[b] > 0){
+                printf("  <%-10ld %ld\n", b == METRICS_BUCKETS - 1 ? (long)hp->max + 1 : 1L << b, hp->buckets[b]);
+            }
+        }
+    }
+}
+
+void METRICS_dump(void)
+{
+    printf("METRICS {\"node\": \"%s\", \"address\": %d", nodeinfo.nodename, nodeinfo.address);
+    for (int m = 0; m < N_METRICS; m++){
+        printf(", \"%s\": %ld", metric_names[m], metrics[m]);
+    }
+    printf(", \"links\": [");
+    for (int link = 1; link <= metrics_nlinks; link++){
+        LINKMETRICS *l = &metrics_link[link];
+
+        printf("%s{\"link\": %d, \"txframes\": %ld, \"txbytes\": %ld, \"rxframes\": %ld, \"rxbytes\": %ld}",
+            link > 1 ? ", " : "", link, l->txframes, l->txbytes, l->rxframes, l->rxbytes);
+    }
+    printf("]");
+    for (int h = 0; h < N_HISTOGRAMS; h++){
+        HIST    *hp = &hists[h];
+        int     last = -1;
+
+        // bucket b counts samples below 2^b usecs, the list stops at the last one in use
+        for (int b = 0; b < METRICS_BUCKETS; b++){
+            if (hp->buckets[b] > 0){
+                last = b;
+            }
+        }
+        printf(", \"%s\": {\"n\": %ld, \"sum\": %ld, \"max\": %ld, \"buckets\": [",
+            hist_names[h], hp->n, (long)hp->sum, (long)hp->max);
+        for (int b = 0; b <= last; b++){
+            printf("%s%ld", b > 0 ? ", " : "", hp->buckets[b]);
+        }
+        printf("]}");
+    }
+    printf("}\n");
+}
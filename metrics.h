@@ -0,0 +1,75 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <cnet.h>
+
+/*  Counters and latency histograms for one node.
+
+    Each node has its own counters, as cnet gives every node its own copy
+    of the protocol's globals. Counting a frame is an increment of a
+    global, done by the macros below, so they can sit on the paths every
+    frame takes. Latencies go into histograms with a bucket for each power
+    of two microseconds, which keeps the tail without keeping the samples.
+
+    METRICS_show() prints everything for the State button. METRICS_dump()
+    prints it again as one line of JSON, starting with "METRICS ", for a
+    script to pick out of the output when the simulation ends.
+ */
+
+//  WHAT IS COUNTED AT EACH NODE
+typedef enum {
+    M_SENT,             // frames the node built and sent, data or control
+    M_FORWARDED,        // frames passed on for another node
+    M_RECEIVED,         // frames read from the physical layer
+    M_DELIVERED,        // messages written to the application layer
+    M_BADCHECKSUM,      // frames thrown away because a checksum failed
+    M_DUPLICATE,        // data frames that had arrived before
+    M_RETRANSMIT,       // data frames sent again
+    M_TIMEOUT,          // retransmission timers that expired
+    M_REBUILT,          // lost data frames rebuilt from parity frames
+    M_COMPRESSED,       // messages sent compressed
+    M_ACKS,             // acks sent in frames of their own
+    N_METRICS
+} METRIC;
+
+//  THE LATENCIES THAT ARE KEPT IN HISTOGRAMS
+typedef enum {
+    H_RTT,              // round trip times measured from frames sent once
+    H_ACKED,            // from a data frame's first sending to its acknowledgement
+    N_HISTOGRAMS
+} HISTOGRAM;
+
+//  BUCKET b HOLDS SAMPLES FROM 2^(b-1) TO 2^b - 1 USECS, THE LAST ONE EVERYTHING LONGER
+#define METRICS_BUCKETS     32
+
+typedef struct {
+    long        txframes, txbytes;
+    long        rxframes, rxbytes;
+} LINKMETRICS;
+
+extern  long        metrics[N_METRICS];
+extern  LINKMETRICS *metrics_link;      // metrics_nlinks + 1 of them, link 0 unused
+extern  int         metrics_nlinks;
+
+//  COUNT ONE EVENT
+#define METRICS_count(m)        (metrics[(m)]++)
+
+//  COUNT A FRAME OF len BYTES WRITTEN TO, OR READ FROM, link
+#define METRICS_tx(link, len)   ((link) >= 1 && (link) <= metrics_nlinks ? \
+    (void)(metrics_link[(link)].txframes++, metrics_link[(link)].txbytes += (len)) : (void)0)
+#define METRICS_rx(link, len)   ((link) >= 1 && (link) <= metrics_nlinks ? \
+    (void)(metrics_link[(link)].rxframes++, metrics_link[(link)].rxbytes += (len)) : (void)0)
+
+//  ZERO EVERY COUNTER AND HISTOGRAM, CALLED FROM reboot_node() ONCE nodeinfo IS SET
+extern  void    METRICS_init(void);
+
+//  ADD A LATENCY, IN USECS, TO A HISTOGRAM
+extern  void    METRICS_sample(HISTOGRAM h, CnetTime usec);
+
+//  PRINT THE COUNTERS, THE TRAFFIC ON EACH LINK AND THE HISTOGRAMS
+extern  void    METRICS_show(void);
+
+//  PRINT THE SAME AS ONE LINE OF JSON
+extern  void    METRICS_dump(void);
+
+#endif
@@ -0,0 +1,170 @@
+#!/bin/sh
+
+#   Runs each protocol in this repository over a set of topologies with the
+#   simulator in sim/cnetsim.c, sweeping frame loss, frame corruption, the
+#   message rate and the message sizes, and prints one CSV row (or JSON
+#   object) per run with the goodput, mean and p99 delivery times, the
+#   retransmission ratio and the wire bytes sent per message byte delivered.
+#
+#   Run it from anywhere; each list below may be replaced with an option:
+#
+#       sim/bench.sh > results.csv
+#       sim/bench.sh -f json -p "lab2b version2" -t "RING line6" -l "0 3 5" -e 2h
+#
+#   Topologies are RING, testTOP or a generated one: lineN (N hosts in a
+#   chain), ringN (N hosts in a cycle) or starN (N hosts around one router).
+#   Loss and corruption are given as cnet gives them, as 1 in 2^N frames
+#   with 0 meaning none.  Sizes are minmessagesize:maxmessagesize in bytes.
+#   A run that ends in a protocol error has that error as its status, and
+#   one that kills the simulator has "crashed (signal N)".
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+SIM="$REPO/sim/cnetsim"
+
+PROTOCOLS="lab2b successtansmit version1 version2"
+TOPOLOGIES="RING testTOP line4 ring6 star5"
+LOSSES="0 4"
+CORRUPTS="0 4"
+RATES="4000ms 1000ms"
+SIZES="4000:32768 100:4096"
+SEEDS="1"
+DURATION="1h"
+FORMAT="csv"
+
+usage() {
+    echo "usage: $0 [-f csv|json] [-e time] [-p protocols] [-t topologies]" >&2
+    echo "          [-l losses] [-c corrupts] [-r rates] [-m sizes] [-S seeds]" >&2
+    exit 1
+}
+
+while getopts "c:e:f:l:m:p:r:S:t:" opt; do
+    case $opt in
+    c)  CORRUPTS=$OPTARG ;;
+    e)  DURATION=$OPTARG ;;
+    f)  FORMAT=$OPTARG ;;
+    l)  LOSSES=$OPTARG ;;
+    m)  SIZES=$OPTARG ;;
+    p)  PROTOCOLS=$OPTARG ;;
+    r)  RATES=$OPTARG ;;
+    S)  SEEDS=$OPTARG ;;
+    t)  TOPOLOGIES=$OPTARG ;;
+    *)  usage ;;
+    esac
+done
+case $FORMAT in
+csv|json)   ;;
+*)          usage ;;
+esac
+
+#   THE FILES EACH PROTOCOL IS COMPILED FROM, AS ON ITS TOPOLOGY'S compile LINE
+sources() {
+    case $1 in
+    lab2b)          files="lab2b.c addrtable.c checksum.c linkqueue.c framepool.c metrics.c trace.c fec.c compress.c" ;;
+    successtansmit) files="successtansmit.c" ;;
+    version1)       files="version1.c checksum.c addrtable.c linkqueue.c framepool.c dupwindow.c metrics.c trace.c" ;;
+    version2)       files="version2.c dvroute.c lsroute.c addrtable.c checksum.c linkqueue.c framepool.c dupwindow.c metrics.c trace.c" ;;
+    *)              echo "$0: unknown protocol '$1'" >&2; exit 1 ;;
+    esac
+    for f in $files; do
+        printf '%s/%s ' "$REPO" "$f"
+    done
+}
+
+#   WRITE THE TOPOLOGY NAMED $1 TO $2, WITH THE SAME LINKS AS RING
+topology() {
+    case $1 in
+    RING|testTOP)
+        cp "$REPO/$1" "$2"
+        return ;;
+    line[0-9]*|ring[0-9]*|star[0-9]*)
+        n=${1#line}; n=${n#ring}; n=${n#star} ;;
+    *)
+        echo "$0: unknown topology '$1'" >&2; exit 1 ;;
+    esac
+    {
+        echo 'bandwidth        = 64 Kbps'
+        echo 'propagationdelay = 750 ms'
+        echo
+        i=0
+        while [ "$i" -lt "$n" ]; do
+            case $1 in
+            line*)  [ $((i + 1)) -lt "$n" ] && echo "host h$i { link to h$((i + 1)) }" \
+                                            || echo "host h$i { }" ;;
+            ring*)  echo "host h$i { link to h$(((i + 1) % n)) }" ;;
+            star*)  echo "host h$i { link to hub }" ;;
+            esac
+            i=$((i + 1))
+        done
+        case $1 in
+        star*)  echo "router hub { }" ;;
+        esac
+    } > "$2"
+}
+
+if [ ! -x "$SIM" ] || [ "$SIM.c" -nt "$SIM" ]; then
+    cc -O2 -rdynamic -o "$SIM" "$SIM.c" -ldl -lm || exit 1
+fi
+WORK=$(mktemp -d /tmp/benchXXXXXX) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+#   THE COLUMNS OF cnetsim -F csv FOLLOW THE PARAMETERS OF EACH RUN
+PARAMS="protocol,topology,probframeloss,probframecorrupt,messagerate,minmessagesize,maxmessagesize,seed,status"
+METRICS="seconds,generated,delivered,bytes_delivered,goodput_bps,mean_latency_us,p99_latency_us,frames_tx,bytes_tx,frames_lost,frames_corrupted,retx_ratio,wire_per_delivered_byte"
+first=1
+case $FORMAT in
+csv)    echo "$PARAMS,$METRICS" ;;
+json)   echo "[" ;;
+esac
+
+for proto in $PROTOCOLS; do
+    compile=$(sources "$proto") || exit 1
+    for topo in $TOPOLOGIES; do
+        topology "$topo" "$WORK/$topo" || exit 1
+        for loss in $LOSSES; do
+        for corrupt in $CORRUPTS; do
+        for rate in $RATES; do
+        for size in $SIZES; do
+        for seed in $SEEDS; do
+            min=${size%:*}
+            max=${size#*:}
+            out=$("$SIM" -q -F "$FORMAT" -S "$seed" -e "$DURATION" \
+                    -A "compile=$compile" -A "probframeloss=$loss" \
+                    -A "probframecorrupt=$corrupt" -A "messagerate=$rate" \
+                    -A "minmessagesize=$min" -A "maxmessagesize=$max" \
+                    "$WORK/$topo" 2>"$WORK/errors")
+            rc=$?
+            if [ $rc -eq 0 ]; then
+                status=ok
+            elif [ $rc -ge 128 ]; then
+                status="crashed (signal $((rc - 128)))"
+                out=
+            else
+                status=$(tail -n 1 "$WORK/errors" | tr -d '",\\')
+                [ -n "$status" ] || status="failed (exit $rc)"
+                out=
+            fi
+
+            if [ "$FORMAT" = csv ]; then
+                echo "$proto,$topo,$loss,$corrupt,$rate,$min,$max,$seed,$status$(
+                    echo "$out" | sed -n '2s/^/,/p')"
+            else
+                [ $first -eq 0 ] && echo ","
+                first=0
+                printf '{"protocol": "%s", "topology": "%s", "probframeloss": %s, ' "$proto" "$topo" "$loss"
+                printf '"probframecorrupt": %s, "messagerate": "%s", "minmessagesize": %s, ' "$corrupt" "$rate" "$min"
+                printf '"maxmessagesize": %s, "seed": %s, "status": "%s"' "$max" "$seed" "$status"
+                if [ -n "$out" ]; then
+                    printf ', %s' "$(echo "$out" | sed 's/^{//')"
+                else
+                    printf '}'
+                fi
+            fi
+        done
+        done
+        done
+        done
+        done
+    done
+done
+[ "$FORMAT" = json ] && printf '\n]\n'
+exit 0
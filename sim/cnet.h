@@ -0,0 +1,121 @@
+#ifndef _CNET_H
+#define _CNET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*  This is the subset of the cnet API used by the protocols in this
+    repository, as provided by the standalone simulator in sim/cnetsim.c.
+
+    The names, types and calling conventions follow cnet's own <cnet.h>
+    so that the same protocol source compiles against either.
+ */
+
+#define MAX_MESSAGE_SIZE        32768
+#define MAX_NODENAME_LEN        32
+
+typedef int                     CnetAddr;
+typedef int64_t                 CnetTime;
+typedef long                    CnetData;
+typedef int32_t                 CnetTimerID;
+
+#define NULLTIMER               ((CnetTimerID)0)
+#define ALLNODES                ((CnetAddr)-1)
+
+typedef enum {
+    EV_NULL = 0,
+    EV_REBOOT,
+    EV_SHUTDOWN,
+    EV_APPLICATIONREADY,
+    EV_PHYSICALREADY,
+    EV_LINKREADY,
+    EV_DEBUG0, EV_DEBUG1, EV_DEBUG2, EV_DEBUG3, EV_DEBUG4,
+    EV_TIMER0, EV_TIMER1, EV_TIMER2, EV_TIMER3, EV_TIMER4,
+    EV_TIMER5, EV_TIMER6, EV_TIMER7, EV_TIMER8, EV_TIMER9,
+    N_CNET_EVENTS
+} CnetEvent;
+
+typedef enum {
+    NT_HOST = 0,
+    NT_ROUTER
+} CnetNodeType;
+
+typedef enum {
+    ER_OK = 0,
+    ER_BADARG,
+    ER_BADEVENT,
+    ER_BADLINK,
+    ER_BADNODE,
+    ER_BADSESSION,
+    ER_BADSIZE,
+    ER_BADTIMERID,
+    ER_CORRUPTFRAME,
+    ER_DUPLICATEMSG,
+    ER_LINKDOWN,
+    ER_MISSINGMSG,
+    ER_NOTFORME,
+    ER_NOTREADY,
+    ER_NOTSUPPORTED,
+    ER_TOOBUSY,
+    N_CNET_ERRORS
+} CnetError;
+
+typedef struct {
+    CnetNodeType        nodetype;
+    int                 nodenumber;
+    CnetAddr            address;
+    char                nodename[MAX_NODENAME_LEN];
+    int                 nlinks;
+    int                 minmessagesize;
+    int                 maxmessagesize;
+    CnetTime            messagerate;
+    CnetTime            time_in_usec;
+} CnetNodeInfo;
+
+typedef struct {
+    int                 linkup;
+    int64_t             bandwidth;          // bits per second
+    CnetTime            propagationdelay;   // usecs
+    int                 mtu;                // bytes
+    double              probframeloss;
+    double              probframecorrupt;
+} CnetLinkInfo;
+
+typedef void (*CnetHandler)(CnetEvent ev, CnetTimerID timer, CnetData data);
+
+#define EVENT_HANDLER(name) \
+        void name(CnetEvent ev, CnetTimerID timer, CnetData data)
+
+extern  CnetNodeInfo    nodeinfo;
+extern  CnetLinkInfo   *linkinfo;
+extern  CnetError       cnet_errno;
+
+extern  int     CNET_set_handler(CnetEvent ev, CnetHandler func, CnetData data);
+extern  int     CNET_set_debug_string(CnetEvent ev, const char *str);
+
+extern  int     CNET_read_application(CnetAddr *dest, void *msg, size_t *len);
+extern  int     CNET_write_application(const void *msg, size_t *len);
+extern  int     CNET_enable_application(CnetAddr dest);
+extern  int     CNET_disable_application(CnetAddr dest);
+
+extern  int     CNET_read_physical(int *link, void *frame, size_t *len);
+extern  int     CNET_write_physical(int link, const void *frame, size_t *len);
+
+extern  CnetTimerID CNET_start_timer(CnetEvent ev, CnetTime usecs, CnetData data);
+extern  int     CNET_stop_timer(CnetTimerID timer);
+extern  int     CNET_timer_data(CnetTimerID timer, CnetData *data);
+
+extern  int     CNET_ccitt(const unsigned char *addr, int nbytes);
+extern  uint32_t CNET_crc32(const unsigned char *addr, int nbytes);
+
+extern  void    CNET_perror(const char *msg);
+extern  void    CNET_exit(const char *filenm, const char *function, int lineno);
+
+#define CHECK(call) do { \
+            if((call) != 0) \
+                CNET_exit(__FILE__, __func__, __LINE__); \
+        } while(0)
+
+#endif
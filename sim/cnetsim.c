@@ -0,0 +1,1466 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <libgen.h>
+#include <sys/stat.h>
+
+#include "cnet.h"
+
+/*  This is a standalone discrete-event simulator for the protocols in this
+    repository.  It implements the subset of the cnet API declared in
+    sim/cnet.h, reads the same topology files as cnet (RING, testTOP),
+    and models each link's bandwidth, propagation delay, probframeloss
+    and probframecorrupt.  There is no GUI; a simulated hour of RING runs
+    in well under a second of wall-clock time.
+
+    Build and run it from the top of the repository:
+
+        cc -O2 -rdynamic -o sim/cnetsim sim/cnetsim.c -ldl -lm
+        sim/cnetsim -e 1h -s RING
+
+    Like cnet, the simulator compiles the files named by the topology's
+    'compile' attribute into a shared object.  Each node gets its own
+    copy of that shared object, so every node has private protocol
+    globals, exactly as it does under cnet.  Extra compiler flags, for
+    example -DWINDOW_SIZE=8, may be given in the CNETCFLAGS environment
+    variable.
+
+    The application layer generates messages with a self-describing
+    header and a deterministic body, so CNET_write_application detects
+    corrupt, misaddressed, duplicate and missing messages and reports
+    them with the same errors that cnet uses.
+ */
+
+#define MAX_NODES               256
+#define MAX_LINKS               32
+#define MAX_TIMERS              (1 << 16)
+#define DEFAULT_MTU             65536
+
+//  THE HEADER OF EACH GENERATED APPLICATION MESSAGE
+typedef struct {
+    int32_t     src, dest;
+    int32_t     seq;
+    int32_t     len;
+    int64_t     gentime;
+} APPHEADER;
+
+//  ONE END OF A POINT-TO-POINT LINK
+typedef struct {
+    int         peer;           // node number at the other end
+    int         peerlink;       // our link's number at the other end
+    CnetTime    busy_until;     // when the current transmission finishes
+} LINKEND;
+
+typedef struct {
+    char        name[MAX_NODENAME_LEN];
+    CnetNodeInfo info;
+    CnetLinkInfo links[MAX_LINKS + 1];  // [0] is the loopback link
+    LINKEND     ends[MAX_LINKS + 1];
+
+    void        *dl;
+    CnetHandler handlers[N_CNET_EVENTS];
+    CnetData    hdata[N_CNET_EVENTS];
+
+    //  application layer
+    int         app_all;                // enabled for ALLNODES
+    unsigned char app_dest[MAX_NODES];  // enabled per destination
+    int         app_scheduled;
+    int         app_pending;
+    APPHEADER   pending;
+    int32_t     nextseq[MAX_NODES];     // next message number to each node
+    int32_t     expected[MAX_NODES];    // next message number from each node
+} NODE;
+
+typedef enum { EVT_FRAME, EVT_TIMER, EVT_APP, EVT_LINKREADY } EVTYPE;
+
+typedef struct {
+    CnetTime    time;
+    uint64_t    order;
+    EVTYPE      type;
+    int         node;
+    int         link;
+    CnetTimerID timer;
+    size_t      len;
+    unsigned char *frame;
+} EVENT;
+
+typedef struct {
+    int         node;
+    int         active;
+    uint16_t    gen;
+    CnetEvent   ev;
+    CnetData    data;
+} TIMER;
+
+//  THE GLOBAL STATE OF THE SIMULATION
+CnetNodeInfo    nodeinfo;
+CnetLinkInfo   *linkinfo;
+CnetError       cnet_errno      = ER_OK;
+
+static NODE     nodes[MAX_NODES];
+static int      nnodes          = 0;
+static int      cur             = -1;
+static CnetTime now             = 0;
+
+static EVENT    *heap           = NULL;
+static size_t   heaplen         = 0, heapcap = 0;
+static uint64_t eventorder      = 0;
+
+static TIMER    timers[MAX_TIMERS];
+static int      timerfree[MAX_TIMERS];
+static int      ntimerfree      = 0, ntimers = 0;
+
+static unsigned char *arriving  = NULL;     // frame being delivered
+static size_t   arrivinglen     = 0;
+static int      arrivinglink    = 0;
+
+static uint64_t rngstate        = 0x9e3779b97f4a7c15ULL;
+
+//  STATISTICS
+static struct {
+    long        msgs_generated, msgs_delivered;
+    long        bytes_generated, bytes_delivered;
+    long        frames_tx, frames_rx, frames_lost, frames_corrupted;
+    long        bytes_tx;
+    long        msg_frames, msg_retx;   // frames carrying a message header, and repeats
+    long        events;
+    CnetTime    *latency;
+    size_t      nlatency, latencycap;
+} stats;
+
+static const char *cnet_errstr[N_CNET_ERRORS] = {
+    "no error",
+    "bad argument",
+    "bad event",
+    "bad link",
+    "bad node",
+    "bad session",
+    "bad size",
+    "bad timer id",
+    "corrupt frame",
+    "duplicate message",
+    "link down",
+    "missing message",
+    "not for me",
+    "not ready",
+    "not supported",
+    "too busy",
+};
+
+// ----------------------------------------------------------------------
+
+static uint64_t rnd64(void)
+{
+    uint64_t z = (rngstate += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double rnd01(void)
+{
+    return (rnd64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void fatal(const char *fmt, const char *arg)
+{
+    fprintf(stderr, "cnetsim: ");
+    fprintf(stderr, fmt, arg);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+// ----------------------------------------------------------------------
+
+static int event_before(const EVENT *a, const EVENT *b)
+{
+    return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static void schedule(EVENT e)
+{
+    if(heaplen == heapcap) {
+        heapcap = heapcap ? 2 * heapcap : 1024;
+        heap    = realloc(heap, heapcap * sizeof(EVENT));
+        if(heap == NULL)
+            fatal("%s", "out of memory");
+    }
+    e.order = eventorder++;
+
+    size_t i = heaplen++;
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if(!event_before(&e, &heap[parent]))
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = e;
+}
+
+static EVENT next_event(void)
+{
+    EVENT top = heap[0];
+    EVENT last = heap[--heaplen];
+    size_t i = 0;
+
+    for(;;) {
+        size_t child = 2 * i + 1;
+        if(child >= heaplen)
+            break;
+        if(child + 1 < heaplen && event_before(&heap[child + 1], &heap[child]))
+            child++;
+        if(!event_before(&heap[child], &last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// ----------------------------------------------------------------------
+
+static void enter_node(int n)
+{
+    if(cur >= 0)
+        nodes[cur].info = nodeinfo;
+    cur                 = n;
+    nodeinfo            = nodes[n].info;
+    nodeinfo.time_in_usec = now;
+    linkinfo            = nodes[n].links;
+}
+
+static void call_handler(int n, CnetEvent ev, CnetTimerID timer, CnetData data)
+{
+    enter_node(n);
+    if(nodes[n].handlers[ev])
+        nodes[n].handlers[ev](ev, timer, data);
+    nodes[n].info = nodeinfo;
+}
+
+// ----------------------------------------------------------------------
+
+int CNET_set_handler(CnetEvent ev, CnetHandler func, CnetData data)
+{
+    if((int)ev <= EV_NULL || ev >= N_CNET_EVENTS) {
+        cnet_errno = ER_BADEVENT;
+        return -1;
+    }
+    nodes[cur].handlers[ev] = func;
+    nodes[cur].hdata[ev]    = data;
+    return 0;
+}
+
+int CNET_set_debug_string(CnetEvent ev, const char *str)
+{
+    (void)str;
+    if(ev < EV_DEBUG0 || ev > EV_DEBUG4) {
+        cnet_errno = ER_BADEVENT;
+        return -1;
+    }
+    return 0;
+}
+
+void CNET_perror(const char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, cnet_errstr[cnet_errno]);
+}
+
+void CNET_exit(const char *filenm, const char *function, int lineno)
+{
+    fflush(stdout);
+    fprintf(stderr, "%s: error at %s:%s():%d at time %lldusec - %s\n",
+            nodes[cur].name, filenm, function, lineno,
+            (long long)now, cnet_errstr[cnet_errno]);
+    exit(2);
+}
+
+int CNET_ccitt(const unsigned char *addr, int nbytes)
+{
+    static uint16_t table[256];
+    static int      init = 0;
+    uint16_t        crc = 0;
+
+    if(!init) {
+        for(int i = 0; i < 256; i++) {
+            uint16_t c = (uint16_t)(i << 8);
+            for(int b = 0; b < 8; b++)
+                c = (c & 0x8000) ? (uint16_t)((c << 1) ^ 0x1021) : (uint16_t)(c << 1);
+            table[i] = c;
+        }
+        init = 1;
+    }
+    while(nbytes-- > 0)
+        crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ *addr++]);
+    return crc;
+}
+
+uint32_t CNET_crc32(const unsigned char *addr, int nbytes)
+{
+    uint32_t crc = 0xffffffff;
+
+    while(nbytes-- > 0) {
+        crc ^= *addr++;
+        for(int b = 0; b < 8; b++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// ----------------------------------------------------------------------
+
+static CnetTime app_interval(const NODE *np)
+{
+    //  UNIFORMLY DISTRIBUTED AROUND THE NODE'S messagerate
+    CnetTime rate = np->info.messagerate;
+    return rate / 2 + (CnetTime)(rnd01() * rate) + 1;
+}
+
+static int app_enabled_for(const NODE *np, int n)
+{
+    return np->app_all || np->app_dest[n];
+}
+
+static void app_schedule(int n)
+{
+    NODE *np = &nodes[n];
+
+    if(np->app_scheduled || np->app_pending)
+        return;
+    np->app_scheduled = 1;
+    schedule((EVENT){ .time = now + app_interval(np), .type = EVT_APP, .node = n });
+}
+
+//  MESSAGES ARE PRINTABLE TEXT ENDING IN A NUL BYTE, AS THEY ARE UNDER cnet:
+//  A FIXED-WIDTH TEXT HEADER FOLLOWED BY A DETERMINISTIC BODY
+#define APP_HEADER_LEN          52
+
+static void app_encode(const APPHEADER *h, unsigned char *msg)
+{
+    uint64_t s = ((uint64_t)h->src << 40) ^ ((uint64_t)h->dest << 20) ^ (uint64_t)h->seq;
+    char     hdr[APP_HEADER_LEN + 1];
+
+    snprintf(hdr, sizeof(hdr), "CNET%08x%08x%08x%08x%016llx",
+             (unsigned)h->src, (unsigned)h->dest, (unsigned)h->seq,
+             (unsigned)h->len, (unsigned long long)h->gentime);
+    memcpy(msg, hdr, APP_HEADER_LEN);
+
+    for(int i = APP_HEADER_LEN; i < h->len - 1; i++) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        msg[i] = (unsigned char)('a' + s % 26);
+    }
+    msg[h->len - 1] = '\0';
+}
+
+static int app_decode(const unsigned char *msg, size_t len, APPHEADER *h)
+{
+    char field[17];
+
+    if(len < APP_HEADER_LEN + 1 || memcmp(msg, "CNET", 4) != 0)
+        return -1;
+    for(int f = 0; f < 5; f++) {
+        int   width = (f < 4) ? 8 : 16;
+        int   at    = 4 + 8 * f;
+        char *end;
+
+        memcpy(field, msg + at, width);
+        field[width] = '\0';
+        unsigned long long v = strtoull(field, &end, 16);
+        if(*end != '\0')
+            return -1;
+        switch(f) {
+        case 0: h->src      = (int32_t)v;   break;
+        case 1: h->dest     = (int32_t)v;   break;
+        case 2: h->seq      = (int32_t)v;   break;
+        case 3: h->len      = (int32_t)v;   break;
+        case 4: h->gentime  = (int64_t)v;   break;
+        }
+    }
+    return 0;
+}
+
+static void app_generate(int n)
+{
+    NODE *np = &nodes[n];
+    int   candidates[MAX_NODES], ncandidates = 0;
+
+    np->app_scheduled = 0;
+    if(np->app_pending)
+        return;
+    for(int d = 0; d < nnodes; d++)
+        if(d != n && nodes[d].info.nodetype == NT_HOST && app_enabled_for(np, d))
+            candidates[ncandidates++] = d;
+    if(ncandidates == 0)
+        return;
+
+    int d       = candidates[rnd64() % ncandidates];
+    int minsize = np->info.minmessagesize;
+    int maxsize = np->info.maxmessagesize;
+
+    if(minsize < APP_HEADER_LEN + 1)
+        minsize = APP_HEADER_LEN + 1;
+    if(maxsize < minsize)
+        maxsize = minsize;
+
+    np->pending.src     = nodes[n].info.address;
+    np->pending.dest    = nodes[d].info.address;
+    np->pending.seq     = np->nextseq[d]++;
+    np->pending.len     = minsize + (int)(rnd64() % (uint64_t)(maxsize - minsize + 1));
+    np->pending.gentime = now;
+    np->app_pending     = 1;
+
+    stats.msgs_generated++;
+    stats.bytes_generated += np->pending.len;
+    call_handler(n, EV_APPLICATIONREADY, 0, np->hdata[EV_APPLICATIONREADY]);
+}
+
+static int node_by_address(CnetAddr addr)
+{
+    for(int n = 0; n < nnodes; n++)
+        if(nodes[n].info.address == addr)
+            return n;
+    return -1;
+}
+
+//  RETRANSMISSIONS ARE COUNTED WITHOUT ANY HELP FROM THE PROTOCOL.  A FRAME
+//  THAT CARRIES THE HEADER OF A GENERATED MESSAGE IS A RETRANSMISSION IF THE
+//  SAME NODE HAS ALREADY SENT THAT MESSAGE'S HEADER ONTO THE SAME LINK.
+//  FORWARDING OR FLOODING A MESSAGE IS NOT A RETRANSMISSION, AND NOR IS ANY
+//  FRAME WITHOUT A MESSAGE HEADER (ACKS, ROUTING, LATER FRAGMENTS).
+static uint64_t *sentset        = NULL;     // open addressing, 0 is empty
+static size_t   sentcap         = 0, nsent = 0;
+
+static int sent_before(uint64_t key)
+{
+    if(2 * (nsent + 1) > sentcap) {
+        size_t    oldcap = sentcap;
+        uint64_t *old    = sentset;
+
+        sentcap = sentcap ? 2 * sentcap : 4096;
+        sentset = calloc(sentcap, sizeof(uint64_t));
+        if(sentset == NULL)
+            fatal("%s", "out of memory");
+        nsent = 0;
+        for(size_t i = 0; i < oldcap; i++)
+            if(old[i])
+                (void)sent_before(old[i]);
+        free(old);
+    }
+    for(size_t i = (key * 0x9e3779b97f4a7c15ULL) >> 20; ; i++) {
+        i &= sentcap - 1;
+        if(sentset[i] == key)
+            return 1;
+        if(sentset[i] == 0) {
+            sentset[i] = key;
+            nsent++;
+            return 0;
+        }
+    }
+}
+
+static void count_retransmission(int link, const unsigned char *frame, size_t len)
+{
+    const unsigned char *at = memmem(frame, len, "CNET", 4);
+    APPHEADER h;
+    int       s, d;
+
+    if(at == NULL || app_decode(at, len - (size_t)(at - frame), &h) != 0)
+        return;
+    if((s = node_by_address(h.src)) < 0 || (d = node_by_address(h.dest)) < 0)
+        return;
+    stats.msg_frames++;
+    if(sent_before(((uint64_t)(cur + 1) << 54) | ((uint64_t)link << 48)
+                   | ((uint64_t)s << 40) | ((uint64_t)d << 32) | (uint32_t)h.seq))
+        stats.msg_retx++;
+}
+
+int CNET_enable_application(CnetAddr dest)
+{
+    NODE *np = &nodes[cur];
+
+    if(dest == ALLNODES)
+        np->app_all = 1;
+    else {
+        int d = node_by_address(dest);
+        if(d < 0) {
+            cnet_errno = ER_BADNODE;
+            return -1;
+        }
+        np->app_dest[d] = 1;
+    }
+    app_schedule(cur);
+    return 0;
+}
+
+int CNET_disable_application(CnetAddr dest)
+{
+    NODE *np = &nodes[cur];
+
+    if(dest == ALLNODES) {
+        np->app_all = 0;
+        memset(np->app_dest, 0, sizeof(np->app_dest));
+    }
+    else {
+        int d = node_by_address(dest);
+        if(d < 0) {
+            cnet_errno = ER_BADNODE;
+            return -1;
+        }
+        np->app_dest[d] = 0;
+        if(np->app_all) {
+            //  ALLNODES MINUS ONE: ENUMERATE THE OTHERS EXPLICITLY
+            np->app_all = 0;
+            for(int n = 0; n < nnodes; n++)
+                np->app_dest[n] = (n != d);
+        }
+    }
+    return 0;
+}
+
+int CNET_read_application(CnetAddr *dest, void *msg, size_t *len)
+{
+    NODE *np = &nodes[cur];
+
+    if(!np->app_pending) {
+        cnet_errno = ER_NOTREADY;
+        return -1;
+    }
+    if(dest == NULL || msg == NULL || len == NULL) {
+        cnet_errno = ER_BADARG;
+        return -1;
+    }
+    if(*len < (size_t)np->pending.len) {
+        cnet_errno = ER_BADSIZE;
+        return -1;
+    }
+    app_encode(&np->pending, msg);
+    *dest   = np->pending.dest;
+    *len    = np->pending.len;
+    np->app_pending = 0;
+    app_schedule(cur);
+    return 0;
+}
+
+int CNET_write_application(const void *msg, size_t *len)
+{
+    static unsigned char expect[MAX_MESSAGE_SIZE];
+    APPHEADER   h;
+
+    if(msg == NULL || len == NULL) {
+        cnet_errno = ER_BADARG;
+        return -1;
+    }
+    if(*len == 0 || *len > MAX_MESSAGE_SIZE) {
+        cnet_errno = ER_BADSIZE;
+        return -1;
+    }
+    if(app_decode(msg, *len, &h) != 0 || h.len != (int32_t)*len) {
+        cnet_errno = ER_CORRUPTFRAME;
+        return -1;
+    }
+    app_encode(&h, expect);
+    if(memcmp(expect, msg, *len) != 0) {
+        cnet_errno = ER_CORRUPTFRAME;
+        return -1;
+    }
+    if(h.dest != nodes[cur].info.address) {
+        cnet_errno = ER_NOTFORME;
+        return -1;
+    }
+    int s = node_by_address(h.src);
+    if(s < 0) {
+        cnet_errno = ER_BADSESSION;
+        return -1;
+    }
+    if(h.seq < nodes[cur].expected[s]) {
+        cnet_errno = ER_DUPLICATEMSG;
+        return -1;
+    }
+    if(h.seq > nodes[cur].expected[s]) {
+        cnet_errno = ER_MISSINGMSG;
+        return -1;
+    }
+    nodes[cur].expected[s]++;
+
+    stats.msgs_delivered++;
+    stats.bytes_delivered += h.len;
+    if(stats.nlatency == stats.latencycap) {
+        stats.latencycap = stats.latencycap ? 2 * stats.latencycap : 1024;
+        stats.latency    = realloc(stats.latency, stats.latencycap * sizeof(CnetTime));
+    }
+    stats.latency[stats.nlatency++] = now - h.gentime;
+    return 0;
+}
+
+// ----------------------------------------------------------------------
+
+int CNET_write_physical(int link, const void *frame, size_t *len)
+{
+    NODE *np = &nodes[cur];
+
+    if(link < 0 || link > np->info.nlinks) {
+        cnet_errno = ER_BADLINK;
+        return -1;
+    }
+    if(frame == NULL || len == NULL) {
+        cnet_errno = ER_BADARG;
+        return -1;
+    }
+    if(*len == 0 || *len > (size_t)np->links[link].mtu) {
+        cnet_errno = ER_BADSIZE;
+        return -1;
+    }
+    if(!np->links[link].linkup) {
+        cnet_errno = ER_LINKDOWN;
+        return -1;
+    }
+
+    EVENT e = { .type = EVT_FRAME, .len = *len };
+
+    e.frame = malloc(*len);
+    if(e.frame == NULL)
+        fatal("%s", "out of memory");
+    memcpy(e.frame, frame, *len);
+
+    if(link == 0) {
+        e.time  = now + 1;
+        e.node  = cur;
+        e.link  = 0;
+        schedule(e);
+        return 0;
+    }
+
+    CnetLinkInfo *li = &np->links[link];
+    LINKEND      *le = &np->ends[link];
+    CnetTime start   = le->busy_until > now ? le->busy_until : now;
+    CnetTime txtime  = (CnetTime)(((double)*len * 8.0 * 1000000.0) / li->bandwidth);
+
+    le->busy_until   = start + txtime;
+    stats.frames_tx++;
+    stats.bytes_tx  += *len;
+    count_retransmission(link, frame, *len);
+
+    if(li->probframeloss > 0.0 && rnd01() < li->probframeloss) {
+        stats.frames_lost++;
+        free(e.frame);
+    }
+    else {
+        if(li->probframecorrupt > 0.0 && rnd01() < li->probframecorrupt) {
+            size_t at = rnd64() % *len;
+            e.frame[at] ^= (unsigned char)(1 + rnd64() % 255);
+            stats.frames_corrupted++;
+        }
+        e.time  = le->busy_until + li->propagationdelay;
+        e.node  = le->peer;
+        e.link  = le->peerlink;
+        schedule(e);
+    }
+    schedule((EVENT){ .time = le->busy_until, .type = EVT_LINKREADY,
+                      .node = cur, .link = link });
+    return 0;
+}
+
+int CNET_read_physical(int *link, void *frame, size_t *len)
+{
+    if(arriving == NULL) {
+        cnet_errno = ER_NOTREADY;
+        return -1;
+    }
+    if(link == NULL || frame == NULL || len == NULL) {
+        cnet_errno = ER_BADARG;
+        return -1;
+    }
+    if(*len < arrivinglen) {
+        cnet_errno = ER_BADSIZE;
+        return -1;
+    }
+    memcpy(frame, arriving, arrivinglen);
+    *len    = arrivinglen;
+    *link   = arrivinglink;
+    return 0;
+}
+
+// ----------------------------------------------------------------------
+
+static TIMER *timer_lookup(CnetTimerID id)
+{
+    if(id <= 0)
+        return NULL;
+
+    int      slot = (id - 1) & (MAX_TIMERS - 1);
+    uint16_t gen  = (uint16_t)((id - 1) >> 16);
+    TIMER   *t    = &timers[slot];
+
+    if(slot >= ntimers || !t->active || t->gen != gen || t->node != cur)
+        return NULL;
+    return t;
+}
+
+static void timer_release(TIMER *t)
+{
+    t->active = 0;
+    t->gen    = (t->gen + 1) & 0x7fff;
+    timerfree[ntimerfree++] = (int)(t - timers);
+}
+
+CnetTimerID CNET_start_timer(CnetEvent ev, CnetTime usecs, CnetData data)
+{
+    int slot;
+
+    if(ev < EV_TIMER0 || ev > EV_TIMER9 || usecs < 0) {
+        cnet_errno = (usecs < 0) ? ER_BADARG : ER_BADEVENT;
+        return NULLTIMER;
+    }
+    if(ntimerfree > 0)
+        slot = timerfree[--ntimerfree];
+    else if(ntimers < MAX_TIMERS)
+        slot = ntimers++;
+    else
+        fatal("%s", "too many outstanding timers");
+
+    TIMER *t    = &timers[slot];
+    t->node     = cur;
+    t->active   = 1;
+    t->ev       = ev;
+    t->data     = data;
+
+    CnetTimerID id = (CnetTimerID)(((int32_t)t->gen << 16) | slot) + 1;
+    schedule((EVENT){ .time = now + usecs, .type = EVT_TIMER, .node = cur, .timer = id });
+    return id;
+}
+
+int CNET_stop_timer(CnetTimerID id)
+{
+    TIMER *t = timer_lookup(id);
+
+    if(t == NULL) {
+        cnet_errno = ER_BADTIMERID;
+        return -1;
+    }
+    timer_release(t);
+    return 0;
+}
+
+int CNET_timer_data(CnetTimerID id, CnetData *data)
+{
+    TIMER *t = timer_lookup(id);
+
+    if(t == NULL || data == NULL) {
+        cnet_errno = (t == NULL) ? ER_BADTIMERID : ER_BADARG;
+        return -1;
+    }
+    *data = t->data;
+    return 0;
+}
+
+// ----------------------------------------------------------------------
+//  TOPOLOGY FILES
+
+typedef struct {
+    char        compile[1024];
+    int64_t     bandwidth;
+    CnetTime    propagationdelay;
+    int         minmessagesize, maxmessagesize;
+    CnetTime    messagerate;
+    double      probframeloss, probframecorrupt;
+    int         mtu;
+} DEFAULTS;
+
+typedef struct {
+    const char  *p;
+    const char  *file;
+    int         line;
+    char        tok[256];
+    int         isstring;
+} LEXER;
+
+static void lex_error(LEXER *lx, const char *what)
+{
+    fprintf(stderr, "cnetsim: %s, line %d: %s\n", lx->file, lx->line, what);
+    exit(1);
+}
+
+//  RETURNS 0 AT END OF INPUT, OTHERWISE THE TOKEN IS IN lx->tok
+static int lex(LEXER *lx)
+{
+    for(;;) {
+        while(isspace((unsigned char)*lx->p)) {
+            if(*lx->p == '\n')
+                lx->line++;
+            lx->p++;
+        }
+        if(lx->p[0] == '/' && lx->p[1] == '/') {
+            while(*lx->p && *lx->p != '\n')
+                lx->p++;
+        }
+        else if(lx->p[0] == '/' && lx->p[1] == '*') {
+            lx->p += 2;
+            while(*lx->p && !(lx->p[0] == '*' && lx->p[1] == '/')) {
+                if(*lx->p == '\n')
+                    lx->line++;
+                lx->p++;
+            }
+            if(*lx->p)
+                lx->p += 2;
+        }
+        else
+            break;
+    }
+    lx->isstring = 0;
+    if(*lx->p == '\0')
+        return 0;
+
+    size_t n = 0;
+    if(*lx->p == '"') {
+        lx->p++;
+        while(*lx->p && *lx->p != '"' && n < sizeof(lx->tok) - 1)
+            lx->tok[n++] = *lx->p++;
+        if(*lx->p != '"')
+            lex_error(lx, "unterminated string");
+        lx->p++;
+        lx->isstring = 1;
+    }
+    else if(strchr("{}=,;", *lx->p))
+        lx->tok[n++] = *lx->p++;
+    else {
+        while(*lx->p && !isspace((unsigned char)*lx->p) && !strchr("{}=,;\"", *lx->p)
+                && n < sizeof(lx->tok) - 1) {
+            //  SPLIT "64Kbps" INTO "64" AND "Kbps"
+            if(n > 0 && isdigit((unsigned char)lx->tok[0]) && isalpha((unsigned char)*lx->p)
+                    && lx->tok[n-1] != 'e' && lx->tok[n-1] != 'E')
+                break;
+            lx->tok[n++] = *lx->p++;
+        }
+    }
+    lx->tok[n] = '\0';
+    return 1;
+}
+
+//  SCALE FACTORS FOR THE UNITS PERMITTED AFTER A NUMERIC VALUE
+static const struct { const char *unit; double scale; } units[] = {
+    { "bps",   1.0 },       { "Kbps",  1e3 },       { "Mbps",  1e6 },
+    { "Gbps",  1e9 },
+    { "usec",  1.0 },       { "usecs", 1.0 },       { "us",    1.0 },
+    { "msec",  1e3 },       { "msecs", 1e3 },       { "ms",    1e3 },
+    { "sec",   1e6 },       { "secs",  1e6 },       { "s",     1e6 },
+    { "bytes", 1.0 },       { "byte",  1.0 },
+    { "KB",    1024.0 },    { "MB",    1048576.0 },
+};
+
+static double parse_value(LEXER *lx)
+{
+    char   *end;
+    double  v;
+
+    if(!lex(lx))
+        lex_error(lx, "value expected");
+    if(lx->isstring)
+        lex_error(lx, "numeric value expected");
+    v = strtod(lx->tok, &end);
+    if(*end != '\0')
+        lex_error(lx, "numeric value expected");
+
+    //  PEEK AT THE NEXT TOKEN FOR A UNIT
+    LEXER save = *lx;
+    if(lex(lx)) {
+        for(size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+            if(strcmp(lx->tok, units[i].unit) == 0)
+                return v * units[i].scale;
+    }
+    *lx = save;
+    return v;
+}
+
+//  cnet EXPRESSES FRAME LOSS AND CORRUPTION AS 1 IN 2^N FRAMES
+static double prob_from_exponent(double n)
+{
+    return (n <= 0.0) ? 0.0 : pow(2.0, -n);
+}
+
+static int apply_attribute(LEXER *lx, const char *name, DEFAULTS *d)
+{
+    if(strcmp(name, "compile") == 0) {
+        if(!lex(lx) || !lx->isstring)
+            lex_error(lx, "string expected for compile");
+        snprintf(d->compile, sizeof(d->compile), "%s", lx->tok);
+    }
+    else if(strcmp(name, "bandwidth") == 0)
+        d->bandwidth = (int64_t)parse_value(lx);
+    else if(strcmp(name, "propagationdelay") == 0)
+        d->propagationdelay = (CnetTime)parse_value(lx);
+    else if(strcmp(name, "minmessagesize") == 0)
+        d->minmessagesize = (int)parse_value(lx);
+    else if(strcmp(name, "maxmessagesize") == 0)
+        d->maxmessagesize = (int)parse_value(lx);
+    else if(strcmp(name, "messagerate") == 0)
+        d->messagerate = (CnetTime)parse_value(lx);
+    else if(strcmp(name, "probframeloss") == 0)
+        d->probframeloss = prob_from_exponent(parse_value(lx));
+    else if(strcmp(name, "probframecorrupt") == 0)
+        d->probframecorrupt = prob_from_exponent(parse_value(lx));
+    else if(strcmp(name, "mtu") == 0)
+        d->mtu = (int)parse_value(lx);
+    else
+        return 0;
+    return 1;
+}
+
+//  GLOBAL ATTRIBUTES GIVEN WITH -A name=value, WHICH WIN OVER THE TOPOLOGY FILE
+#define MAX_OVERRIDES           32
+
+static const char *overrides[MAX_OVERRIDES];
+static int      noverrides      = 0;
+
+static const char *override_value(const char *name)
+{
+    size_t len = strlen(name);
+
+    for(int i = 0; i < noverrides; i++)
+        if(strncmp(overrides[i], name, len) == 0 && overrides[i][len] == '=')
+            return overrides[i] + len + 1;
+    return NULL;
+}
+
+static void apply_overrides(DEFAULTS *d)
+{
+    for(int i = 0; i < noverrides; i++) {
+        const char *eq = strchr(overrides[i], '=');
+        char        name[256];
+
+        if(eq == NULL || eq == overrides[i] || (size_t)(eq - overrides[i]) >= sizeof(name))
+            fatal("bad attribute '%s', expected name=value", overrides[i]);
+        snprintf(name, sizeof(name), "%.*s", (int)(eq - overrides[i]), overrides[i]);
+
+        //  THE SHELL HAS USUALLY REMOVED THE QUOTES AROUND A compile STRING
+        if(strcmp(name, "compile") == 0 && eq[1] != '"') {
+            snprintf(d->compile, sizeof(d->compile), "%s", eq + 1);
+            continue;
+        }
+        LEXER lx = { .p = eq + 1, .file = overrides[i], .line = 1 };
+        if(!apply_attribute(&lx, name, d))
+            fatal("unknown global attribute '%s'", name);
+        if(lex(&lx))
+            fatal("bad attribute '%s'", overrides[i]);
+    }
+}
+
+typedef struct {
+    int         from, to;
+    char        toname[MAX_NODENAME_LEN];
+    DEFAULTS    attrs;
+} LINKDECL;
+
+static int find_node(const char *name)
+{
+    for(int n = 0; n < nnodes; n++)
+        if(strcmp(nodes[n].name, name) == 0)
+            return n;
+    return -1;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char *buf;
+    long  n;
+
+    if(fp == NULL)
+        fatal("cannot open %s", path);
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    rewind(fp);
+    buf = malloc(n + 1);
+    if(buf == NULL || fread(buf, 1, n, fp) != (size_t)n)
+        fatal("cannot read %s", path);
+    buf[n] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static void parse_topology(const char *path, DEFAULTS *global)
+{
+    static LINKDECL decls[MAX_NODES * MAX_LINKS];
+    static DEFAULTS nodeattrs[MAX_NODES];
+    int             ndecls = 0;
+    char           *text = read_file(path);
+    LEXER           lx = { .p = text, .file = path, .line = 1 };
+
+    while(lex(&lx)) {
+        char word[256];
+
+        snprintf(word, sizeof(word), "%s", lx.tok);
+        if(strcmp(word, "host") == 0 || strcmp(word, "router") == 0) {
+            if(!lex(&lx))
+                lex_error(&lx, "node name expected");
+
+            //  NODES ARE NUMBERED IN ORDER OF DECLARATION
+            if(find_node(lx.tok) >= 0)
+                lex_error(&lx, "node declared twice");
+            if(nnodes == MAX_NODES)
+                lex_error(&lx, "too many nodes");
+
+            if(strlen(lx.tok) >= MAX_NODENAME_LEN)
+                lex_error(&lx, "node name too long");
+
+            int n = nnodes++;
+            strcpy(nodes[n].name, lx.tok);
+            nodes[n].info.nodenumber = n;
+            nodes[n].info.address    = -2;
+            nodes[n].info.nodetype = (word[0] == 'h') ? NT_HOST : NT_ROUTER;
+            nodeattrs[n] = *global;
+
+            if(!lex(&lx) || strcmp(lx.tok, "{") != 0)
+                lex_error(&lx, "'{' expected");
+            while(lex(&lx) && strcmp(lx.tok, "}") != 0) {
+                char attr[256];
+
+                if(strcmp(lx.tok, ",") == 0 || strcmp(lx.tok, ";") == 0)
+                    continue;
+                snprintf(attr, sizeof(attr), "%s", lx.tok);
+                if(strcmp(attr, "link") == 0) {
+                    if(!lex(&lx) || strcmp(lx.tok, "to") != 0)
+                        lex_error(&lx, "'to' expected after 'link'");
+                    if(!lex(&lx))
+                        lex_error(&lx, "node name expected after 'link to'");
+                    if(strlen(lx.tok) >= MAX_NODENAME_LEN)
+                        lex_error(&lx, "node name too long");
+                    decls[ndecls].from  = n;
+                    strcpy(decls[ndecls].toname, lx.tok);
+                    decls[ndecls].attrs = *global;
+
+                    //  OPTIONAL PER-LINK ATTRIBUTES
+                    LEXER save = lx;
+                    if(lex(&lx) && strcmp(lx.tok, "{") == 0) {
+                        while(lex(&lx) && strcmp(lx.tok, "}") != 0) {
+                            char la[256];
+
+                            if(strcmp(lx.tok, ",") == 0 || strcmp(lx.tok, ";") == 0)
+                                continue;
+                            snprintf(la, sizeof(la), "%s", lx.tok);
+                            if(!lex(&lx) || strcmp(lx.tok, "=") != 0)
+                                lex_error(&lx, "'=' expected");
+                            if(!apply_attribute(&lx, la, &decls[ndecls].attrs))
+                                lex_error(&lx, "unknown link attribute");
+                        }
+                    }
+                    else
+                        lx = save;
+                    ndecls++;
+                    continue;
+                }
+                if(!lex(&lx) || strcmp(lx.tok, "=") != 0)
+                    lex_error(&lx, "'=' expected");
+                if(strcmp(attr, "x") == 0 || strcmp(attr, "y") == 0)
+                    (void)parse_value(&lx);
+                else if(strcmp(attr, "address") == 0)
+                    nodes[n].info.address = (CnetAddr)parse_value(&lx);
+                else if(!apply_attribute(&lx, attr, &nodeattrs[n]))
+                    lex_error(&lx, "unknown node attribute");
+            }
+        }
+        else {
+            if(!lex(&lx) || strcmp(lx.tok, "=") != 0)
+                lex_error(&lx, "'=' expected");
+            if(override_value(word) != NULL) {
+                DEFAULTS ignored = *global;
+
+                if(!apply_attribute(&lx, word, &ignored))
+                    lex_error(&lx, "unknown global attribute");
+            }
+            else if(!apply_attribute(&lx, word, global))
+                lex_error(&lx, "unknown global attribute");
+        }
+    }
+    free(text);
+
+    for(int n = 0; n < nnodes; n++) {
+        NODE *np = &nodes[n];
+        snprintf(np->info.nodename, sizeof(np->info.nodename), "%s", np->name);
+        if(np->info.address == -2)
+            np->info.address = n;
+        np->info.minmessagesize = nodeattrs[n].minmessagesize;
+        np->info.maxmessagesize = nodeattrs[n].maxmessagesize;
+        np->info.messagerate    = nodeattrs[n].messagerate;
+        np->links[0] = (CnetLinkInfo){ .linkup = 1, .bandwidth = INT64_MAX,
+                                       .mtu = DEFAULT_MTU };
+    }
+
+    //  LINKS ARE NUMBERED FROM 1 AT EACH NODE, IN ORDER OF DECLARATION
+    for(int i = 0; i < ndecls; i++) {
+        int a = decls[i].from, b = find_node(decls[i].toname);
+
+        if(b < 0)
+            fatal("'%s' is linked to but never declared", decls[i].toname);
+        NODE *na = &nodes[a], *nb = &nodes[b];
+
+        if(a == b)
+            fatal("node '%s' is linked to itself", na->name);
+        if(na->info.nlinks == MAX_LINKS || nb->info.nlinks == MAX_LINKS)
+            fatal("too many links at node '%s'", na->name);
+
+        int la = ++na->info.nlinks;
+        int lb = ++nb->info.nlinks;
+        CnetLinkInfo li = {
+            .linkup             = 1,
+            .bandwidth          = decls[i].attrs.bandwidth,
+            .propagationdelay   = decls[i].attrs.propagationdelay,
+            .mtu                = decls[i].attrs.mtu,
+            .probframeloss      = decls[i].attrs.probframeloss,
+            .probframecorrupt   = decls[i].attrs.probframecorrupt,
+        };
+        if(li.bandwidth <= 0)
+            fatal("link from '%s' has no bandwidth", na->name);
+
+        na->links[la] = li;
+        nb->links[lb] = li;
+        na->ends[la]  = (LINKEND){ .peer = b, .peerlink = lb };
+        nb->ends[lb]  = (LINKEND){ .peer = a, .peerlink = la };
+    }
+}
+
+// ----------------------------------------------------------------------
+//  COMPILING AND LOADING THE PROTOCOL
+
+static char tmpdir[PATH_MAX];
+
+static void remove_tmpdir(void)
+{
+    char cmd[PATH_MAX + 16];
+
+    if(tmpdir[0]) {
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", tmpdir);
+        if(system(cmd) != 0)
+            fprintf(stderr, "cnetsim: cannot remove %s\n", tmpdir);
+    }
+}
+
+static void include_dir(char *dir, size_t size)
+{
+    const char *env = getenv("CNETSIM_INCLUDE");
+    char        exe[PATH_MAX];
+    ssize_t     n;
+
+    if(env) {
+        snprintf(dir, size, "%s", env);
+        return;
+    }
+    n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if(n < 0)
+        fatal("%s", "cannot find the simulator's directory; set CNETSIM_INCLUDE");
+    exe[n] = '\0';
+    snprintf(dir, size, "%s", dirname(exe));
+}
+
+static void compile_protocol(const char *topology, const DEFAULTS *global, int verbose)
+{
+    char topodir[PATH_MAX], incdir[PATH_MAX], copy[PATH_MAX];
+    char cmd[8192], sources[4096] = "";
+    const char *cc     = getenv("CC");
+    const char *cflags = getenv("CNETCFLAGS");
+    char *list, *file, *save;
+    int   n;
+
+    if(global->compile[0] == '\0')
+        fatal("%s: no 'compile' attribute", topology);
+
+    snprintf(copy, sizeof(copy), "%s", topology);
+    snprintf(topodir, sizeof(topodir), "%s", dirname(copy));
+    include_dir(incdir, sizeof(incdir));
+
+    //  EACH SOURCE FILE IS RELATIVE TO THE TOPOLOGY FILE
+    list = strdup(global->compile);
+    for(file = strtok_r(list, " \t", &save); file; file = strtok_r(NULL, " \t", &save)) {
+        size_t used = strlen(sources);
+
+        if(file[0] == '-' || file[0] == '/')
+            n = snprintf(sources + used, sizeof(sources) - used, " %s", file);
+        else
+            n = snprintf(sources + used, sizeof(sources) - used, " '%s/%s'", topodir, file);
+        if(n < 0 || (size_t)n >= sizeof(sources) - used)
+            fatal("%s", "the 'compile' attribute is too long");
+    }
+    free(list);
+
+    snprintf(tmpdir, sizeof(tmpdir), "/tmp/cnetsimXXXXXX");
+    if(mkdtemp(tmpdir) == NULL)
+        fatal("%s", "cannot create a temporary directory");
+    atexit(remove_tmpdir);
+
+    n = snprintf(cmd, sizeof(cmd), "%s -shared -fPIC -O2 -I'%s' %s -o '%s/protocol.so'%s -lm",
+                 cc ? cc : "cc", incdir, cflags ? cflags : "", tmpdir, sources);
+    if(n < 0 || (size_t)n >= sizeof(cmd))
+        fatal("%s", "the compilation command is too long");
+    if(verbose)
+        fprintf(stderr, "%s\n", cmd);
+    if(system(cmd) != 0)
+        fatal("compilation of \"%s\" failed", global->compile);
+}
+
+static void load_protocol(int n)
+{
+    char src[PATH_MAX + 32], dst[PATH_MAX + 32], cmd[2 * PATH_MAX + 128];
+
+    snprintf(src, sizeof(src), "%s/protocol.so", tmpdir);
+    snprintf(dst, sizeof(dst), "%s/node%d.so", tmpdir, n);
+    snprintf(cmd, sizeof(cmd), "cp '%s' '%s'", src, dst);
+    if(system(cmd) != 0)
+        fatal("cannot copy %s", src);
+
+    nodes[n].dl = dlopen(dst, RTLD_NOW | RTLD_LOCAL);
+    if(nodes[n].dl == NULL)
+        fatal("%s", dlerror());
+}
+
+// ----------------------------------------------------------------------
+
+static CnetTime parse_duration(const char *s)
+{
+    char   *end;
+    double  v = strtod(s, &end);
+
+    if(end == s)
+        fatal("bad duration '%s'", s);
+    if(*end == '\0' || strcmp(end, "s") == 0)
+        return (CnetTime)(v * 1e6);
+    if(strcmp(end, "ms") == 0)
+        return (CnetTime)(v * 1e3);
+    if(strcmp(end, "us") == 0)
+        return (CnetTime)v;
+    if(strcmp(end, "m") == 0)
+        return (CnetTime)(v * 60e6);
+    if(strcmp(end, "h") == 0)
+        return (CnetTime)(v * 3600e6);
+    if(strcmp(end, "d") == 0)
+        return (CnetTime)(v * 86400e6);
+    fatal("bad duration '%s'", s);
+    return 0;
+}
+
+static int compare_time(const void *a, const void *b)
+{
+    CnetTime x = *(const CnetTime *)a, y = *(const CnetTime *)b;
+    return (x > y) - (x < y);
+}
+
+typedef enum { STATS_TEXT, STATS_CSV, STATS_JSON } STATSFORMAT;
+
+static void print_stats(FILE *fp, CnetTime duration, STATSFORMAT format)
+{
+    double secs = duration / 1e6;
+    double mean = 0.0;
+    CnetTime p99 = 0;
+
+    if(stats.nlatency > 0) {
+        for(size_t i = 0; i < stats.nlatency; i++)
+            mean += stats.latency[i];
+        mean /= stats.nlatency;
+        qsort(stats.latency, stats.nlatency, sizeof(CnetTime), compare_time);
+        p99 = stats.latency[(stats.nlatency * 99 + 99) / 100 - 1];
+    }
+
+    double goodput  = secs > 0 ? stats.bytes_delivered * 8.0 / secs : 0.0;
+    double retx     = stats.msg_frames > 0 ? (double)stats.msg_retx / stats.msg_frames : 0.0;
+    double wire     = stats.bytes_delivered > 0 ? (double)stats.bytes_tx / stats.bytes_delivered : 0.0;
+
+    //  ONE ROW PER RUN, SO THAT RUNS CAN BE COLLECTED BY A SCRIPT
+    if(format == STATS_CSV) {
+        fprintf(fp, "seconds,generated,delivered,bytes_delivered,goodput_bps,"
+                    "mean_latency_us,p99_latency_us,frames_tx,bytes_tx,frames_lost,"
+                    "frames_corrupted,retx_ratio,wire_per_delivered_byte\n");
+        fprintf(fp, "%.3f,%ld,%ld,%ld,%.1f,%.0f,%lld,%ld,%ld,%ld,%ld,%.4f,%.4f\n",
+                secs, stats.msgs_generated, stats.msgs_delivered, stats.bytes_delivered,
+                goodput, mean, (long long)p99, stats.frames_tx, stats.bytes_tx,
+                stats.frames_lost, stats.frames_corrupted, retx, wire);
+        return;
+    }
+    if(format == STATS_JSON) {
+        fprintf(fp, "{\"seconds\": %.3f, \"generated\": %ld, \"delivered\": %ld, "
+                    "\"bytes_delivered\": %ld, \"goodput_bps\": %.1f, "
+                    "\"mean_latency_us\": %.0f, \"p99_latency_us\": %lld, "
+                    "\"frames_tx\": %ld, \"bytes_tx\": %ld, \"frames_lost\": %ld, "
+                    "\"frames_corrupted\": %ld, \"retx_ratio\": %.4f, "
+                    "\"wire_per_delivered_byte\": %.4f}\n",
+                secs, stats.msgs_generated, stats.msgs_delivered, stats.bytes_delivered,
+                goodput, mean, (long long)p99, stats.frames_tx, stats.bytes_tx,
+                stats.frames_lost, stats.frames_corrupted, retx, wire);
+        return;
+    }
+
+    fprintf(fp, "Simulation time           : %.3f sec\n", secs);
+    fprintf(fp, "Events                    : %ld\n", stats.events);
+    fprintf(fp, "Messages generated        : %ld\n", stats.msgs_generated);
+    fprintf(fp, "Messages delivered        : %ld\n", stats.msgs_delivered);
+    fprintf(fp, "Message bytes delivered   : %ld\n", stats.bytes_delivered);
+    fprintf(fp, "Goodput (bps)             : %.1f\n", goodput);
+    fprintf(fp, "Average delivery time     : %.0f usec\n", mean);
+    fprintf(fp, "p99 delivery time         : %lld usec\n", (long long)p99);
+    fprintf(fp, "Frames transmitted        : %ld\n", stats.frames_tx);
+    fprintf(fp, "Frame bytes transmitted   : %ld\n", stats.bytes_tx);
+    fprintf(fp, "Frames lost               : %ld\n", stats.frames_lost);
+    fprintf(fp, "Frames corrupted          : %ld\n", stats.frames_corrupted);
+    fprintf(fp, "Retransmitted messages    : %ld of %ld (%.2f%%)\n",
+            stats.msg_retx, stats.msg_frames, 100.0 * retx);
+    fprintf(fp, "Wire bytes per AL byte    : %.3f\n", wire);
+    fprintf(fp, "Efficiency (AL/PL bytes)  : %.2f%%\n",
+            stats.bytes_tx > 0 ? 100.0 * stats.bytes_delivered / stats.bytes_tx : 0.0);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "usage: %s [-A name=value] [-d] [-e time] [-F format] [-q] [-s] [-S seed] [-v] topologyfile\n"
+        "  -A name=value  set a global attribute, overriding the topology file\n"
+        "  -d       press every node's EV_DEBUG0 button when the simulation ends\n"
+        "  -e time  run for the given simulated time, e.g. 30s, 5m, 2h (default 5m)\n"
+        "  -F fmt   print the statistics as text, csv or json (implies -s)\n"
+        "  -q       quiet; discard the protocol's own output\n"
+        "  -s       print statistics when the simulation ends\n"
+        "  -S seed  seed the random number generator\n"
+        "  -v       show the compilation command\n",
+        argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DEFAULTS    global = {
+        .bandwidth          = 56000,
+        .propagationdelay   = 2500,
+        .minmessagesize     = 100,
+        .maxmessagesize     = 4096,
+        .messagerate        = 1000000,
+        .mtu                = DEFAULT_MTU,
+    };
+    CnetTime    duration = 5 * 60 * 1000000LL;
+    int         debug = 0, quiet = 0, showstats = 0, verbose = 0;
+    int         opt, savedout = -1;
+    STATSFORMAT format = STATS_TEXT;
+
+    while((opt = getopt(argc, argv, "A:de:F:qsS:v")) != -1) {
+        switch(opt) {
+        case 'A':
+            if(noverrides == MAX_OVERRIDES)
+                fatal("%s", "too many -A attributes");
+            overrides[noverrides++] = optarg;
+            break;
+        case 'd':   debug = 1;                              break;
+        case 'e':   duration = parse_duration(optarg);      break;
+        case 'F':
+            if(strcmp(optarg, "text") == 0)
+                format = STATS_TEXT;
+            else if(strcmp(optarg, "csv") == 0)
+                format = STATS_CSV;
+            else if(strcmp(optarg, "json") == 0)
+                format = STATS_JSON;
+            else
+                usage(argv[0]);
+            showstats = 1;
+            break;
+        case 'q':   quiet = 1;                              break;
+        case 's':   showstats = 1;                          break;
+        case 'S':   rngstate = strtoull(optarg, NULL, 0);   break;
+        case 'v':   verbose = 1;                            break;
+        default:    usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1)
+        usage(argv[0]);
+
+    apply_overrides(&global);
+    parse_topology(argv[optind], &global);
+    if(nnodes == 0)
+        fatal("%s: no nodes", argv[optind]);
+    compile_protocol(argv[optind], &global, verbose);
+
+    if(quiet) {
+        fflush(stdout);
+        savedout = dup(1);
+        if(freopen("/dev/null", "w", stdout) == NULL)
+            fatal("%s", "cannot open /dev/null");
+    }
+
+    //  REBOOT EVERY NODE AT TIME ZERO
+    for(int n = 0; n < nnodes; n++) {
+        EVENT_HANDLER((*reboot));
+
+        load_protocol(n);
+        *(void **)&reboot = dlsym(nodes[n].dl, "reboot_node");
+        if(reboot == NULL)
+            fatal("%s", "the protocol does not define reboot_node()");
+        enter_node(n);
+        reboot(EV_REBOOT, 0, 0);
+        nodes[n].info = nodeinfo;
+    }
+
+    //  THE MAIN EVENT LOOP
+    while(heaplen > 0 && heap[0].time <= duration) {
+        EVENT e = next_event();
+
+        now = e.time;
+        stats.events++;
+        switch(e.type) {
+        case EVT_FRAME:
+            stats.frames_rx++;
+            arriving     = e.frame;
+            arrivinglen  = e.len;
+            arrivinglink = e.link;
+            call_handler(e.node, EV_PHYSICALREADY, 0, nodes[e.node].hdata[EV_PHYSICALREADY]);
+            arriving     = NULL;
+            free(e.frame);
+            break;
+
+        case EVT_TIMER: {
+            //  A TIMER'S HANDLER RECEIVES THE DATA GIVEN TO CNET_start_timer
+            enter_node(e.node);
+            TIMER *t = timer_lookup(e.timer);
+            if(t != NULL) {
+                CnetEvent ev = t->ev;
+                CnetData  d  = t->data;
+
+                timer_release(t);
+                call_handler(e.node, ev, e.timer, d);
+            }
+            break;
+        }
+        case EVT_APP:
+            app_generate(e.node);
+            break;
+
+        case EVT_LINKREADY:
+            //  ONLY ANNOUNCE THE LINK ONCE IT HAS NOTHING LEFT TO SEND
+            if(nodes[e.node].ends[e.link].busy_until <= now)
+                call_handler(e.node, EV_LINKREADY, 0, (CnetData)e.link);
+            break;
+        }
+    }
+    now = duration;
+
+    if(quiet && debug) {
+        fflush(stdout);
+        dup2(savedout, 1);
+    }
+    for(int n = 0; n < nnodes; n++) {
+        if(debug)
+            call_handler(n, EV_DEBUG0, 0, nodes[n].hdata[EV_DEBUG0]);
+        call_handler(n, EV_SHUTDOWN, 0, nodes[n].hdata[EV_SHUTDOWN]);
+    }
+    fflush(stdout);
+
+    //  A TABLE OF STATISTICS GOES TO STDOUT, EVEN WITH -q, SO IT CAN BE COLLECTED
+    if(showstats && format != STATS_TEXT) {
+        if(savedout >= 0)
+            dup2(savedout, 1);
+        print_stats(stdout, duration, format);
+    }
+    else if(showstats)
+        print_stats(stderr, duration, format);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <cnet.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+/*  A ring of trace records for one node, see trace.h.
+
+    trace_next counts every event ever recorded, so the ring holds the
+    last min(trace_next, TRACE_SIZE) of them and the oldest is at
+    trace_next - that many. The file is written with one fwrite() for
+    the header and at most two for the records, where the ring wraps.
+ */
+
+#if TRACE_SIZE & (TRACE_SIZE - 1)
+#error TRACE_SIZE must be a power of two
+#endif
+
+TRACEREC    trace_ring[TRACE_SIZE > 0 ? TRACE_SIZE : 1];
+uint64_t    trace_next      = 0;
+
+
+void TRACE_init(void)
+{
+    trace_next = 0;
+}
+
+int TRACE_dump(void)
+{
+#if TRACE_SIZE > 0
+    TRACEHEADER hdr;
+    char        path[64];
+    FILE        *fp;
+    uint64_t    first;
+    size_t      start, n;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.recsize = sizeof(TRACEREC);
+    hdr.address = nodeinfo.address;
+    hdr.count = (trace_next < TRACE_SIZE) ? (uint32_t)trace_next : TRACE_SIZE;
+    hdr.total = trace_next;
+    snprintf(hdr.nodename, sizeof(hdr.nodename), "%s", nodeinfo.nodename);
+
+    snprintf(path, sizeof(path), "trace-%s.bin", nodeinfo.nodename);
+    if ((fp = fopen(path, "wb")) == NULL){
+        LOG(LOG_ERROR, "cannot write %s\n", path);
+        return -1;
+    }
+    first = trace_next - hdr.count;
+    start = first & (TRACE_SIZE - 1);
+    n = (start + hdr.count > TRACE_SIZE) ? TRACE_SIZE - start : hdr.count;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(&trace_ring[start], sizeof(TRACEREC), n, fp);
+    fwrite(&trace_ring[0], sizeof(TRACEREC), hdr.count - n, fp);
+    if (fclose(fp) != 0){
+        LOG(LOG_ERROR, "cannot write %s\n", path);
+        return -1;
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#ifndef TRACE_DECODER
+#include <cnet.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+
+/*  Logging and tracing for the protocols.
+
+    LOG() prints a line only if its level is at or below LOG_LEVEL, chosen
+    when the protocol is built, e.g. with -DLOG_LEVEL=LOG_FRAME in
+    CNETCFLAGS. The test is on constants, so the compiler removes a LOG()
+    above the level along with its arguments:
+
+    LOG_NONE      nothing at all.
+    LOG_ERROR     running out of memory, and frames that cannot be routed.
+    LOG_INFO      the default, frames dropped by a queue and routing changes.
+    LOG_FRAME     a line for every frame sent, forwarded and received.
+
+    TRACE() records an event in a ring of the last TRACE_SIZE events at
+    this node, a few stores into a 32-byte record and no formatting.
+    TRACE_dump() writes the ring to trace-<nodename>.bin when the
+    simulation ends, and tracedump.c decodes one or more of those files
+    into text, merged in time order. Build with -DTRACE_SIZE=0 to leave
+    tracing out.
+ */
+
+#define LOG_NONE            0
+#define LOG_ERROR           1
+#define LOG_INFO            2
+#define LOG_FRAME           3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           LOG_INFO
+#endif
+
+#define LOG(level, ...)     do { if (LOG_LEVEL >= (level)) printf(__VA_ARGS__); } while (0)
+
+//  THE NUMBER OF EVENTS KEPT AT EACH NODE, A POWER OF TWO, 0 FOR NO TRACING
+#ifndef TRACE_SIZE
+#define TRACE_SIZE          4096
+#endif
+
+//  WHAT HAPPENED TO A FRAME
+typedef enum {
+    TR_SEND,            // built here and written to a link
+    TR_RESEND,          // a data frame written to a link again
+    TR_FORWARD,         // passed on for another node
+    TR_RECEIVE,         // read from a link
+    TR_DELIVER,         // its message written to the application layer
+    TR_BADCHECKSUM,     // thrown away because a checksum failed
+    TR_DUPLICATE,       // a data frame that had arrived before
+    TR_TIMEOUT,         // the retransmission timer of a frame expired
+    TR_DROP,            // dropped by a link queue
+    TR_REBUILT,         // a lost data frame rebuilt from parity frames
+    N_TRACE_EVENTS
+} TRACEEVENT;
+
+//  THE KIND OF FRAME, AS FAR AS THE TRACE IS CONCERNED
+typedef enum {
+    TK_DATA,
+    TK_ACK,
+    TK_NAK,
+    TK_ROUTE,           // a routing message
+    TK_UNKNOWN,         // its header could not be trusted
+    TK_PARITY,          // forward error correction
+    N_TRACE_KINDS
+} TRACEKIND;
+
+typedef struct {
+    int64_t     time;       // nodeinfo.time_in_usec
+    int32_t     src, dest;
+    int32_t     seq, ack;
+    uint32_t    len;        // the frame's length on the wire
+    uint8_t     event;      // a TRACEEVENT
+    uint8_t     kind;       // a TRACEKIND
+    uint16_t    link;
+} TRACEREC;
+
+//  THE START OF A TRACE FILE, FOLLOWED BY count RECORDS, OLDEST FIRST, IN THE BYTE ORDER
+//  OF THE MACHINE THAT WROTE IT
+#define TRACE_MAGIC         "CNTR"
+#define TRACE_VERSION       1
+
+typedef struct {
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    recsize;    // sizeof(TRACEREC)
+    int32_t     address;
+    uint32_t    count;      // the records in the file
+    uint64_t    total;      // the events recorded, more than count once the ring has wrapped
+    char        nodename[32];
+} TRACEHEADER;
+
+extern  TRACEREC    trace_ring[];
+extern  uint64_t    trace_next;
+
+//  RECORD AN EVENT AT THIS NODE
+#define TRACE(ev, k, s, d, sq, ak, lk, ln)  do { if (TRACE_SIZE > 0){                    \
+    TRACEREC *_r = &trace_ring[trace_next++ & (TRACE_SIZE - 1)];                        \
+    _r->time = nodeinfo.time_in_usec; _r->event = (ev); _r->kind = (k);                  \
+    _r->src = (s); _r->dest = (d); _r->seq = (sq); _r->ack = (ak);                       \
+    _r->link = (uint16_t)(lk); _r->len = (uint32_t)(ln); } } while (0)
+
+#ifndef TRACE_DECODER
+//  EMPTY THE RING
+extern  void    TRACE_init(void);
+
+//  WRITE THE RING TO trace-<nodename>.bin, RETURN -1 IF IT CANNOT BE WRITTEN
+extern  int     TRACE_dump(void);
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+#define TRACE_DECODER
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/*  The offline decoder for the trace files written by trace.c.
+
+    Build it outside cnet with:
+
+        cc -O2 -o tracedump tracedump.c
+
+    and run ./tracedump trace-*.bin after a simulation. The records of
+    every file are merged in time order, events at the same time keeping
+    the order they happened in at each node, and printed one per line:
+
+        time(s)  node  event  kind  src->dest  seq  ack  link  len
+
+    A file whose ring wrapped only holds its node's last TRACE_SIZE
+    events, and the decoder says how many were lost. Trace files are
+    written in the byte order of the machine that ran the simulation,
+    so decode them on the same kind of machine.
+ */
+
+static  const char *event_names[N_TRACE_EVENTS] = {
+    "send", "resend", "forward", "receive", "deliver",
+    "badchecksum", "duplicate", "timeout", "drop", "rebuilt",
+};
+static  const char *kind_names[N_TRACE_KINDS] = {
+    "DATA", "ACK", "NAK", "ROUTE", "?", "PARITY",
+};
+
+typedef struct {
+    TRACEREC    rec;
+    int         file;   // which file, for the node's name
+    size_t      order;  // its place in that file
+} ENTRY;
+
+static  TRACEHEADER *headers    = NULL;
+static  ENTRY       *entries    = NULL;
+static  size_t      nentries    = 0;
+
+//  READ ONE TRACE FILE, ADDING ITS RECORDS TO entries, RETURN -1 IF IT IS NOT A TRACE FILE
+static int load(const char *path, int file)
+{
+    FILE        *fp = fopen(path, "rb");
+    TRACEHEADER *h = &headers[file];
+    ENTRY       *grown;
+
+    if (fp == NULL){
+        perror(path);
+        return -1;
+    }
+    if (fread(h, sizeof(*h), 1, fp) != 1 || memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) != 0){
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if (h->version != TRACE_VERSION || h->recsize != sizeof(TRACEREC)){
+        fprintf(stderr, "%s: trace version %d with %d-byte records, expected version %d with %d\n",
+            path, h->version, h->recsize, TRACE_VERSION, (int)sizeof(TRACEREC));
+        fclose(fp);
+        return -1;
+    }
+    h->nodename[sizeof(h->nodename) - 1] = '\0';
+    grown = realloc(entries, (nentries + h->count) * sizeof(ENTRY));
+    if (grown == NULL){
+        fprintf(stderr, "%s: out of memory\n", path);
+        fclose(fp);
+        return -1;
+    }
+    entries = grown;
+    for (uint32_t i = 0; i < h->count; i++){
+        ENTRY *e = &entries[nentries];
+
+        if (fread(&e->rec, sizeof(TRACEREC), 1, fp) != 1){
+            fprintf(stderr, "%s: truncated after %u records\n", path, i);
+            break;
+        }
+        e->file = file;
+        e->order = i;
+        nentries++;
+    }
+    if (h->total > h->count){
+        fprintf(stderr, "%s: the first %llu of %llu events were overwritten\n", h->nodename,
+            (unsigned long long)(h->total - h->count), (unsigned long long)h->total);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int by_time(const void *a, const void *b)
+{
+    const ENTRY *x = a, *y = b;
+
+    if (x->rec.time != y->rec.time){
+        return (x->rec.time < y->rec.time) ? -1 : 1;
+    }
+    if (x->file != y->file){
+        return x->file - y->file;
+    }
+    return (x->order < y->order) ? -1 : (x->order > y->order);
+}
+
+int main(int argc, char *argv[])
+{
+    int     bad = 0;
+
+    if (argc < 2){
+        fprintf(stderr, "usage: %s trace-file ...\n", argv[0]);
+        exit(1);
+    }
+    headers = calloc(argc - 1, sizeof(TRACEHEADER));
+    if (headers == NULL){
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        exit(1);
+    }
+    for (int f = 1; f < argc; f++){
+        if (load(argv[f], f - 1) != 0){
+            bad = 1;
+        }
+    }
+    qsort(entries, nentries, sizeof(ENTRY), by_time);
+
+    printf("%-14s %-12s %-11s %-6s %-13s %6s %6s %4s %6s\n",
+        "time(s)", "node", "event", "kind", "src->dest", "seq", "ack", "link", "len");
+    for (size_t i = 0; i < nentries; i++){
+        TRACEREC    *r = &entries[i].rec;
+        char        route[32];
+
+        snprintf(route, sizeof(route), "%d->%d", r->src, r->dest);
+        printf("%-14.6f %-12s %-11s %-6s %-13s %6d %6d %4d %6u\n",
+            r->time / 1e6, headers[entries[i].file].nodename,
+            r->event < N_TRACE_EVENTS ? event_names[r->event] : "?",
+            r->kind < N_TRACE_KINDS ? kind_names[r->kind] : "?",
+            route, r->seq, r->ack, r->link, r->len);
+    }
+    return bad;
+}
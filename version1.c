@@ -2,12 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "addrtable.h"
+#include "checksum.h"
+#include "dupwindow.h"
+#include "framepool.h"
+#include "linkqueue.h"
+#include "metrics.h"
+#include "trace.h"
+
 /*  This is an implementation of a stop-and-wait data link protocol.
 
     This protocol provides a reliable data-link layer for a 2-node network.
     This protocol employs only data and acknowledgement frames -
     piggybacking and negative acknowledgements are not used.
 
+    Each host keeps a separate connection, with its own sequence numbers
+    and timer, for every other host it exchanges frames with, so a slow
+    destination only holds up the messages for that destination.
+
+    Sequence numbers run up to SEQ_MASK rather than alternating between 0
+    and 1, because a frame sent both ways round the ring arrives twice and
+    the later copy can turn up long after the next frame. The receiver
+    keeps a duplicate window of the sequence numbers it has seen from each
+    host (dupwindow.c), so a copy that turns up late is acknowledged again
+    but never delivered twice.
+
+    Frames are kept in buffers from the frame pool. A message is read from
+    the application straight into the frame that carries it, and every
+    transmission of that frame shares the one buffer. A frame that has to
+    go out with a different header while an earlier transmission of it is
+    still queued is copied first, so the queued one is left as it was.
+
     It is based on Tanenbaum's 'protocol 4', 2nd edition, p227.
  */
 
@@ -24,8 +49,9 @@ typedef struct {
 //  THE FIRST FIELDS IN THE STRUCTURE DEFINE THE FRAME HEADER
     CnetAddr    src,dest; 	// source and destination node addresses
     size_t	    len;       	// the length of the msg field only
-    int         checksum;  	// checksum of the whole frame
-    int         seq;        // seq > 0 for valid data, else = -1
+    uint16_t    hdrsum;     // internet checksum of the header, patched by routers as hop_count changes
+    int         datasum;    // checksum() of the msg field, only checked by the destination
+    int         seq;        // seq >= 0 for valid data, else = -1
     int         ack;        // ack > 0 for valid ack, else = -1    
     // new fields for part 3
     int         hop_count;  // an int value to store the hop count (how many nodes the message has passed through)
@@ -36,13 +62,16 @@ typedef struct {
     MSG          msg;
 } FRAME;
 
-//  a SWCONN struct to hold the connection state
+//  a SWCONN struct to hold the state of the connection with one other host, kept in the connections table
 typedef struct {
     CnetAddr    src,dest; 	// source and destination connection addresses
-    CnetTimerID lasttimer;
-    FRAME       lastframe;
-    int         ackexpected, frameexpected, nextframetosend;
-    int         link;  // the link number of the link used in the src
+    CnetTimerID lasttimer;  // the timer of lastframe, NULLTIMER once it has been acknowledged
+    FRAME       *lastframe;  // the data frame waiting for its ack, NULL once it has been acknowledged
+    int         ackexpected, nextframetosend;
+    DUPWINDOW   received;  // the sequence numbers of the data frames delivered from dest
+    int         link;  // the link lastframe was sent on, 0 if it went on every link
+    CnetTime    firstsent;  // when lastframe was first sent
+    int         sends;  // how many times lastframe has been sent, on however many links
 } SWCONN;
 
 //  A struct that stores the shortest path to a node after receiving an ack message from that node
@@ -67,26 +96,19 @@ typedef struct {
 //  SOME HELPFUL MACROS FOR COMMON CALCULATIONS
 #define FRAME_HEADER_SIZE	(sizeof(FRAME) - sizeof(MSG))
 #define FRAME_SIZE(frame)	(FRAME_HEADER_SIZE + frame.len)
-#define increment(seq)		seq = 1-seq
+#define SEQ_BITS            16
+#define SEQ_MASK            ((1 << SEQ_BITS) - 1)
+#define increment(seq)		seq = (seq + 1) & SEQ_MASK
 #define MAX_PATH_LENGTH 14
 
 //  GLOBAL VARIABLES
-SWCONN      swconn[10]; // 10 connections in this part
-SHORTEST_PATH_TABLE_SENDER shortest_path_table_sender[14]; // maximum 14 nodes in this part
-SHORTEST_PATH_TABLE_RECEIVER shortest_path_table_receiver[14]; // maximum 14 nodes in this part
-int shortest_path_table_sender_index = 0;
-int shortest_path_table_receiver_index = 0;
+ADDRTABLE   connections; // a pointer to the SWCONN with each host, created on first contact
+ADDRTABLE   shortest_path_table_sender; // a SHORTEST_PATH_TABLE_SENDER for each destination, any number of nodes
+ADDRTABLE   shortest_path_table_receiver; // a SHORTEST_PATH_TABLE_RECEIVER for each source
 
 //  STATE VARIABLES HOLDING INFORMATION ABOUT THE LAST MESSAGE
-MSG       	lastmsg;
-size_t		lastmsglength		= 0;
 CnetTimerID	lasttimer		= NULLTIMER;
 
-//  STATE VARIABLES HOLDING SEQUENCE NUMBERS
-int		nextdatatosend		= 0;
-int       	ackexpected		= 0;
-int		dataexpected		= 0;
-
 //  if receiced all the addr msg from the neighbour, set to 1
 int     identify_shortest_path = 0;
 CnetAddr   neighbour_addr[2];
@@ -97,281 +119,354 @@ void FRAME_print (FRAME *f) {
      	    f->src, f->dest, f->seq, f->ack, f->len);
 }
 
+//  PRINT A FRAME AND WHAT HAPPENED TO IT, ONLY IF EVERY FRAME IS LOGGED
+#define FRAME_log(what, f)  do { if (LOG_LEVEL >= LOG_FRAME){ printf("%s:  ", (what)); FRAME_print(f); } } while (0)
+
+//  AN ACK CARRIES THE SEQUENCE NUMBER IT ACKNOWLEDGES IN ack, A DATA FRAME HAS ack = -1
+#define TRACE_FRAME(ev, f, link, len)   TRACE((ev), (f)->ack > -1 ? TK_ACK : TK_DATA, \
+    (f)->src, (f)->dest, (f)->seq, (f)->ack, (link), (len))
+
 //  A function to init the connection state
-void SWCONN_init(int swconn_index){
-    swconn[swconn_index].src = nodeinfo.address;
-    swconn[swconn_index].dest = -1;
-    swconn[swconn_index].lasttimer = NULLTIMER;
-    swconn[swconn_index].ackexpected = 0;
-    swconn[swconn_index].frameexpected = 0;
-    swconn[swconn_index].nextframetosend = 0;
-    swconn[swconn_index].link = swconn_index;
+void SWCONN_init(SWCONN *conn, CnetAddr dest){
+    conn->src = nodeinfo.address;
+    conn->dest = dest;
+    conn->lasttimer = NULLTIMER;
+    conn->lastframe = NULL;
+    conn->ackexpected = 0;
+    conn->nextframetosend = 0;
+    DUPWINDOW_init(&conn->received, SEQ_BITS);
+    conn->link = 0;
+    conn->firstsent = 0;
+    conn->sends = 0;
 }
-//  A FUNCTION TO TRANSMIT EITHER A DATA OR AN ACKNOWLEDGMENT FRAME
-void transmit_frame(CnetAddr destaddr, MSG *msg, size_t length, int seqno, int ackno, int link, int shortest_path_link, int found_shortest_path)
+
+//  FIND THE CONNECTION WITH A HOST, OR NULL IF WE HAVE NEVER HEARD OF IT
+SWCONN *SWCONN_lookup(CnetAddr dest){
+    SWCONN **conn = ADDRTABLE_find(&connections, dest);
+
+    return (conn == NULL) ? NULL : *conn;
+}
+
+//  FIND THE CONNECTION WITH A HOST, OPENING IT ON FIRST CONTACT
+SWCONN *SWCONN_find(CnetAddr dest){
+    SWCONN *conn = SWCONN_lookup(dest);
+    SWCONN **slot;
+
+    if (conn != NULL){
+        return conn;
+    }
+    // each SWCONN has its own allocation, so it stays put when the table grows
+    conn = malloc(sizeof(SWCONN));
+    if (conn == NULL){
+        return NULL;
+    }
+    slot = ADDRTABLE_insert(&connections, dest);
+    if (slot == NULL){
+        free(conn);
+        return NULL;
+    }
+    *slot = conn;
+    SWCONN_init(conn, dest);
+    return conn;
+}
+//  A FUNCTION TO TRANSMIT AN ACKNOWLEDGMENT FRAME, DATA FRAMES ARE BUILT ONCE, IN THE CONNECTION
+void transmit_frame(CnetAddr destaddr, int seqno, int ackno, int link, int shortest_path_link, int found_shortest_path)
 {
-    FRAME       frame;
+    FRAME       *frame = FRAMEPOOL_alloc();
+
+    if (frame == NULL){
+        LOG(LOG_ERROR, "out of memory, ack to %d dropped\n", destaddr);
+        return;
+    }
 
 //  INITIALISE THE FRAME'S HEADER FIELDS
-    frame.src       = nodeinfo.address;
-    frame.dest      = destaddr;
-    frame.seq       = seqno;
-    frame.ack       = ackno;
-    frame.checksum  = 0;
-    frame.len       = length;
+    frame->src       = nodeinfo.address;
+    frame->dest      = destaddr;
+    frame->seq       = seqno;
+    frame->ack       = ackno;
+    frame->hdrsum    = 0;
+    frame->len       = 0;
     // new fields for part 3
-    frame.link_used_in_src = link;
-    frame.shortest_path_link = shortest_path_link;
-    frame.found_shortest_path = found_shortest_path;
-    frame.hop_count = 0;
+    frame->link_used_in_src = link;
+    frame->shortest_path_link = shortest_path_link;
+    frame->found_shortest_path = found_shortest_path;
+    frame->hop_count = 0;
 
-    if (ackno < 0){
-        if (seqno > -1){
-            // DATA transmit
-            CnetTime	timeout;
-
-            printf("DATA transmitted:  ");
-            FRAME_print (&frame);
-            memcpy(&frame.msg, msg, length);
-
-            timeout =
-                FRAME_SIZE(frame)*((CnetTime)8000000 / linkinfo[link].bandwidth) +
-                        linkinfo[link].propagationdelay;
-
-            printf("timeout = %ld\n", timeout);
-            for (int i = 1; i <= nodeinfo.nlinks; i++){
-                if (swconn[i].link == link){
-                    swconn[i].lastframe = frame;
-                    swconn[i].lasttimer = CNET_start_timer(EV_TIMER1, 3 * timeout, 0);
-                    printf("when transmit data, start timer --> link: %d\n", i);
-                    // (CnetData)i
-                }
-            }
-        }
-    }
-    else {
-        // ACK transmit
-        printf("ACK sent:  ");
-        FRAME_print (&frame);
-    }
+    // ACK transmit
+    FRAME_log("ACK sent", frame);
 
 //  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
-    length		= FRAME_SIZE(frame);
-    frame.checksum	= CNET_ccitt((unsigned char *)&frame, length);
-    printf("src;    checksum: %d\n", frame.checksum);
-    CHECK(CNET_write_physical(link, &frame, &length));
+    frame->datasum	= checksum(&frame->msg, frame->len);
+    frame->hdrsum	= inet_checksum(frame, FRAME_HEADER_SIZE);
+    LOG(LOG_FRAME, "src;    checksum: %d\n", frame->datasum);
+    METRICS_count(M_SENT);
+    TRACE_FRAME(TR_SEND, frame, link, FRAME_SIZE((*frame)));
+    METRICS_tx(link, FRAME_SIZE((*frame)));
+    LINKQUEUE_write(link, frame, FRAME_SIZE((*frame)));
+    FRAMEPOOL_release(frame);
 }
 
-void transmit_frame_to_next_hop(FRAME frame, int link){
-    // int stored_checksum;
-    // size_t	 len = sizeof(FRAME);
-    if (frame.ack < 0){
-        if (frame.seq > -1){
+//  SEND THE FRAME A CONNECTION IS WAITING ON DOWN ONE LINK. ITS PAYLOAD CHECKSUM WAS WORKED OUT
+//  ONCE, WHEN THE FRAME WAS BUILT, ONLY THE HEADER CHANGES FROM ONE TRANSMISSION TO THE NEXT
+void transmit_lastframe(SWCONN *conn, int link, int shortest_path_link, int found_shortest_path)
+{
+    FRAME   *f = conn->lastframe;
+
+    if (FRAMEPOOL_refs(f) > 1 && (f->link_used_in_src != link ||
+            f->shortest_path_link != shortest_path_link || f->found_shortest_path != found_shortest_path)){
+        // a link queue still holds the frame with its old header, so change a copy instead
+        FRAME *copy = FRAMEPOOL_alloc();
+
+        if (copy == NULL){
+            LOG(LOG_ERROR, "out of memory, frame to %d not sent\n", conn->dest);
+            return;
+        }
+        memcpy(copy, f, FRAME_SIZE((*f)));
+        FRAMEPOOL_release(f);
+        conn->lastframe = f = copy;
+    }
+    f->link_used_in_src = link;
+    f->shortest_path_link = shortest_path_link;
+    f->found_shortest_path = found_shortest_path;
+    f->hop_count = 0;
+
+    // DATA transmit
+    FRAME_log("DATA transmitted", f);
+    f->hdrsum	= 0;
+    f->hdrsum	= inet_checksum(f, FRAME_HEADER_SIZE);
+    LOG(LOG_FRAME, "src;    checksum: %d\n", f->datasum);
+    METRICS_count(M_SENT);
+    TRACE_FRAME(conn->sends > 1 ? TR_RESEND : TR_SEND, f, link, FRAME_SIZE((*f)));
+    METRICS_tx(link, FRAME_SIZE((*f)));
+    LINKQUEUE_write(link, f, FRAME_SIZE((*f)));
+}
+
+//  PASS ON A FRAME FOR ANOTHER HOST, THE PAYLOAD AND ITS CHECKSUM ARE LEFT ALONE
+void transmit_frame_to_next_hop(FRAME *frame, size_t length, int link){
+    if (frame->ack < 0){
+        if (frame->seq > -1){
             // DATA transmit
-            printf("DATA transmitted:  ");
-            FRAME_print (&frame);
-            frame.hop_count++;
-            // stored_checksum = CNET_ccitt((unsigned char *)&frame, len);
-            // printf("non-consecutive; arriving_checksum: %d, stored_checksum: %d\n", frame.checksum, stored_checksum);
+            int oldhops = frame->hop_count;
 
+            FRAME_log("DATA transmitted", frame);
+            frame->hop_count++;
+            // only the hop count has changed, so patch the header checksum rather than recompute it
+            frame->hdrsum = inet_checksum_update(frame->hdrsum, oldhops, frame->hop_count);
         }
     }
     else {
         // ACK transmit
-        printf("ACK sent:  ");
-        FRAME_print (&frame);
+        FRAME_log("ACK sent", frame);
     }
 
     //  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
-    // frame.len		= FRAME_SIZE(frame);
-    // frame.checksum	= CNET_ccitt((unsigned char *)&frame, frame.len);
-    CHECK(CNET_write_physical(link, &frame, &frame.len));
+    METRICS_count(M_FORWARDED);
+    TRACE_FRAME(TR_FORWARD, frame, link, length);
+    METRICS_tx(link, length);
+    LINKQUEUE_write(link, frame, length);
 }
 
 
+//  SEND THE FRAME A CONNECTION IS WAITING ON, ON THE SHORTEST PATH IF WE KNOW IT AND ELSE ON EVERY LINK,
+//  AND START ITS TIMER. THE TIMER'S DATA IS THE DESTINATION, SO THE TIMEOUT CAN FIND THE CONNECTION
+void send_lastframe(SWCONN *conn){
+    FRAME   *f;
+    SHORTEST_PATH_TABLE_SENDER *sender = ADDRTABLE_find(&shortest_path_table_sender, conn->dest);
+    int     link = 1;
+    CnetTime timeout;
+
+    if (conn->sends++ == 0){
+        conn->firstsent = nodeinfo.time_in_usec;
+    }
+    else {
+        METRICS_count(M_RETRANSMIT);
+    }
+    if (sender != NULL && sender->found == 1){
+        link = sender->shortest_path_link;
+        conn->link = link;
+        transmit_lastframe(conn, link, link, 1);
+    }
+    else {
+        // send msg in both directions to find the shortest path
+        conn->link = 0;
+        for (int i = 1; i <= nodeinfo.nlinks; i++){
+            transmit_lastframe(conn, i, -1, 0);
+        }
+    }
+    // transmit_lastframe() may have moved the frame to a copy
+    f = conn->lastframe;
+    timeout = FRAME_SIZE((*f))*((CnetTime)8000000 / linkinfo[link].bandwidth) +
+                linkinfo[link].propagationdelay;
+    conn->lasttimer = CNET_start_timer(EV_TIMER1, 3 * timeout, (CnetData)conn->dest);
+}
+
 //  THE APPLICATION LAYER HAS A NEW MESSAGE TO BE DELIVERED
 EVENT_HANDLER(application_ready)
 {
     CnetAddr destaddr;
-    FRAME   lastframe;
-    lastmsglength  = sizeof(MSG);
-    CHECK(CNET_read_application(&destaddr, &lastmsg, &lastmsglength));
-    CNET_disable_application(ALLNODES);
-
-    int ackno = -1; 
-    lastframe.src       = nodeinfo.address;
-    lastframe.dest      = destaddr;
-    lastframe.seq       = nextdatatosend;
-    lastframe.ack       = ackno;
-    lastframe.checksum  = 0;
-    lastframe.len       = lastmsglength;
-    // increment # for nextdatatosend
-    increment(nextdatatosend);
-
-    int have_shortest_path = 0;
-    for (int i = 0; i < 14; i++){
-        if (shortest_path_table_sender[i].dest == lastframe.dest){
-            if (shortest_path_table_sender[i].found == 1){
-                have_shortest_path = 1;
-                // transmit the shortest path back to the source
-                transmit_frame(destaddr, &lastmsg, lastmsglength, nextdatatosend, ackno, shortest_path_table_sender[i].shortest_path_link, shortest_path_table_sender[i].shortest_path_link, 1);
-                // update swconn
-                int j = shortest_path_table_sender[i].shortest_path_link;
-                memcpy(&lastframe.msg, &lastmsg, lastmsglength);
-                swconn[j].lastframe = lastframe;
-                // add to swconn
-                swconn[j].nextframetosend = nextdatatosend;
-                break;
-            }
-            
-        }
+    SWCONN  *conn;
+    FRAME   *lastframe = FRAMEPOOL_alloc();
+    size_t  length = sizeof(MSG);
+    MSG     discard;
+
+    if (lastframe == NULL){
+        // the message must still be taken, or the application layer stalls
+        CHECK(CNET_read_application(&destaddr, &discard, &length));
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        return;
     }
-    if (have_shortest_path == 0){
-        // initialize the shortest_path_table_sender for the first time for the destination host
-        int init_sender_table = 0;
-        for (int i = 0; i < 14; i++){
-            if (shortest_path_table_sender[i].dest == destaddr){
-                init_sender_table = 1;
-                break;
-            }
-        }
-        if (init_sender_table == 0){
-            shortest_path_table_sender[shortest_path_table_sender_index].dest = destaddr;
-            shortest_path_table_sender[shortest_path_table_sender_index].found = 0;
-            shortest_path_table_sender_index++;
-        }
-        // send msg in both directions to find the shortest path
-        for (int i = 1; i <= nodeinfo.nlinks; i++){
-            transmit_frame(destaddr, &lastmsg, lastmsglength, nextdatatosend, ackno, i, -1, 0);
-            // update swconn
-            for (int j = 1; j <= nodeinfo.nlinks; j++){
-                memcpy(&lastframe.msg, &lastmsg, lastmsglength);
-                swconn[j].lastframe = lastframe;
-                // add to swconn
-                swconn[j].nextframetosend = nextdatatosend;
-            
-            }
+    // the message goes straight into the frame that will carry it
+    CHECK(CNET_read_application(&destaddr, &lastframe->msg, &length));
+
+    conn = SWCONN_find(destaddr);
+    if (conn == NULL){
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        FRAMEPOOL_release(lastframe);
+        return;
+    }
+    // only messages for this host wait for the ack, the others can still go
+    CNET_disable_application(destaddr);
+
+    // initialize the shortest_path_table_sender for the first time for the destination host
+    if (ADDRTABLE_find(&shortest_path_table_sender, destaddr) == NULL){
+        SHORTEST_PATH_TABLE_SENDER *sender = ADDRTABLE_insert(&shortest_path_table_sender, destaddr);
+        if (sender != NULL){
+            sender->dest = destaddr;
+            sender->found = 0;
         }
-        
     }
+
+    lastframe->src       = nodeinfo.address;
+    lastframe->dest      = destaddr;
+    lastframe->seq       = conn->nextframetosend;
+    lastframe->ack       = -1;
+    lastframe->hdrsum    = 0;
+    lastframe->len       = length;
+    lastframe->link_used_in_src = 0;
+    lastframe->shortest_path_link = -1;
+    lastframe->found_shortest_path = 0;
+    lastframe->datasum   = checksum(&lastframe->msg, length);
+    FRAMEPOOL_release(conn->lastframe);
+    conn->lastframe = lastframe;
+    conn->sends = 0;
+    // increment # for nextframetosend
+    increment(conn->nextframetosend);
+
+    send_lastframe(conn);
 }
 
-//  PROCESS THE ARRIVAL OF A NEW FRAME, VERIFY CHECKSUM, ACT ON ITS FRAMEKIND
-EVENT_HANDLER(physical_ready)
+//  VERIFY THE CHECKSUMS OF A NEW FRAME, ACT ON ITS FRAMEKIND
+void frame_arrived(FRAME *frame, size_t len, int link)
 {
-    FRAME        frame;
-    int          link, arriving_checksum, stored_checksum;
-    size_t	 len = sizeof(FRAME);
-
-    //  RECEIVE THE NEW FRAME
-    CHECK(CNET_read_physical(&link, &frame, &len));
+    int          stored_checksum;
+
+    //  CHECK THE HEADER ON EVERY HOP, IT IS ONLY A FEW BYTES
+    if (len < FRAME_HEADER_SIZE || inet_checksum(frame, FRAME_HEADER_SIZE) != 0 || FRAME_SIZE((*frame)) != len){
+        LOG(LOG_INFO, "BAD frame received:  header checksum\n");
+        METRICS_count(M_BADCHECKSUM);
+        TRACE(TR_BADCHECKSUM, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+        return;           // bad checksum, just ignore frame
+    }
+    TRACE_FRAME(TR_RECEIVE, frame, link, len);
 
     //  handle the frame
-    if (frame.dest == nodeinfo.address && nodeinfo.nodetype == NT_HOST){
-        //  CALCULATE THE CHECKSUM OF THE ARRIVING FRAME, IGNORE IF INVALID
-        arriving_checksum	= frame.checksum;
-        frame.checksum  	= 0;
-        stored_checksum = CNET_ccitt((unsigned char *)&frame, len);
-        printf("->arrive dest; arriving_checksum: %d, stored_checksum: %d\n", arriving_checksum, stored_checksum);
-        if(stored_checksum != arriving_checksum) {
-            printf(">>1 BAD frame received:  checksums  (stored=%d, computed=%d)\n",stored_checksum, arriving_checksum);
+    if (frame->dest == nodeinfo.address && nodeinfo.nodetype == NT_HOST){
+        //  CALCULATE THE CHECKSUM OF THE PAYLOAD, ONLY THE DESTINATION DOES THIS
+        stored_checksum = checksum(&frame->msg, frame->len);
+        LOG(LOG_FRAME, "->arrive dest; arriving_checksum: %d, stored_checksum: %d\n", frame->datasum, stored_checksum);
+        if(stored_checksum != frame->datasum) {
+            LOG(LOG_INFO, ">>1 BAD frame received:  checksums  (stored=%d, computed=%d)\n",stored_checksum, frame->datasum);
+            METRICS_count(M_BADCHECKSUM);
+            TRACE_FRAME(TR_BADCHECKSUM, frame, link, len);
             return;           // bad checksum, just ignore frame
         }
         //  use if statement to determine if frame is data or ack
-        if (frame.ack > -1){
+        if (frame->ack > -1){
             // ACK receive
-            // if(frame.seq == swconn[link].ackexpected) {
-                printf("ACK received:  ");
-                FRAME_print (&frame);
-                if (frame.found_shortest_path == 1){
-                    printf("shortest path found: %d\n", frame.shortest_path_link);
-                }
-                else{
-                    printf("shortest path not found\n");
-                }
-                
-                printf("when stop timer, --> link: %d\n", frame.link_used_in_src);
-                for (int i = 1; i <= nodeinfo.nlinks; i++){
-                    CNET_stop_timer(swconn[i].lasttimer);
-                    increment(swconn[i].ackexpected);
-                }
-                // add to swconn
-                // swconn[link].ackexpected = ackexpected;
-
-                // update the SHORTEST_PATH_TABLE_SENDER
-                for (int i = 0; i < 14; i++){
-                    if (shortest_path_table_sender[i].dest == frame.src && shortest_path_table_sender[i].found == 0 && frame.found_shortest_path == 1){
-                        shortest_path_table_sender[i].found = 1;
-                        shortest_path_table_sender[i].shortest_path_link = frame.shortest_path_link;
-                        break;
-                    }
+            SWCONN *conn = SWCONN_lookup(frame->src);
+
+            FRAME_log("ACK received", frame);
+            if (frame->found_shortest_path == 1){
+                LOG(LOG_FRAME, "shortest path found: %d\n", frame->shortest_path_link);
+            }
+            else{
+                LOG(LOG_FRAME, "shortest path not found\n");
+            }
+
+            // update the SHORTEST_PATH_TABLE_SENDER, the ack of either copy of a frame may carry the path
+            SHORTEST_PATH_TABLE_SENDER *sender = ADDRTABLE_find(&shortest_path_table_sender, frame->src);
+            if (sender != NULL && sender->found == 0 && frame->found_shortest_path == 1){
+                sender->found = 1;
+                sender->shortest_path_link = frame->shortest_path_link;
+            }
+
+            // a frame sent on every link is acknowledged once per copy, only the first ack counts
+            if (conn != NULL && conn->lasttimer != NULLTIMER && frame->seq == conn->ackexpected){
+                LOG(LOG_FRAME, "when stop timer, --> link: %d\n", frame->link_used_in_src);
+                CNET_stop_timer(conn->lasttimer);
+                conn->lasttimer = NULLTIMER;
+                // only a frame sent once gives a round trip time that can be trusted (Karn)
+                if (conn->sends == 1){
+                    METRICS_sample(H_RTT, nodeinfo.time_in_usec - conn->firstsent);
                 }
-                CNET_enable_application(ALLNODES);
-            // }
+                METRICS_sample(H_ACKED, nodeinfo.time_in_usec - conn->firstsent);
+                FRAMEPOOL_release(conn->lastframe);
+                conn->lastframe = NULL;
+                increment(conn->ackexpected);
+                CNET_enable_application(frame->src);
+            }
         }
         else {
             // DATA receive
-            // if(frame.seq == swconn[link].frameexpected) {
-                printf("DATA received:  ");
-                FRAME_print (&frame);
-                len = frame.len;
-                CHECK(CNET_write_application(&frame.msg, &len));
-                increment(swconn[link].frameexpected);
-                // add to swconn
-            
-
-                // init the SHORTEST_PATH_TABLE_RECEIVER for the first time or update it if it already exists
-                int init_receiver_table = 0;
-                for (int i = 0; i < 14; i++){
-                    if (shortest_path_table_receiver[i].src == frame.src && shortest_path_table_receiver[i].received == 1){
-                        init_receiver_table = 1;
-                        shortest_path_table_receiver[i].anti_clock_wise_link = frame.link_used_in_src;
-                        shortest_path_table_receiver[i].anti_clock_wise_path_length = frame.hop_count;
-
-                        // identify the shortest path and send the message to the source host
-                        if (shortest_path_table_receiver[i].clock_wise_path_length < shortest_path_table_receiver[i].anti_clock_wise_path_length){
-                            // send the message to the source host
-                            frame.shortest_path_link = shortest_path_table_receiver[i].clock_wise_link;
-                            
-                        }
-                        else{
-                            // send the message to the source host
-                            frame.shortest_path_link = shortest_path_table_receiver[i].anti_clock_wise_link;
-                            }
-                        frame.found_shortest_path = 1;
-                        break;
-                    }
+            SWCONN *conn = SWCONN_find(frame->src);
+
+            FRAME_log("DATA received", frame);
+            // the second copy of a frame sent both ways round is only used to measure the path
+            if (conn != NULL && DUPWINDOW_accept(&conn->received, frame->seq)){
+                len = frame->len;
+                CHECK(CNET_write_application(&frame->msg, &len));
+                METRICS_count(M_DELIVERED);
+                TRACE_FRAME(TR_DELIVER, frame, 0, len);
+            }
+            else {
+                METRICS_count(M_DUPLICATE);
+                TRACE_FRAME(TR_DUPLICATE, frame, link, len);
+            }
+
+            // init the SHORTEST_PATH_TABLE_RECEIVER for the first time or update it if it already exists
+            SHORTEST_PATH_TABLE_RECEIVER *receiver = ADDRTABLE_find(&shortest_path_table_receiver, frame->src);
+            if (receiver != NULL && receiver->received == 1){
+                receiver->anti_clock_wise_link = frame->link_used_in_src;
+                receiver->anti_clock_wise_path_length = frame->hop_count;
+
+                // identify the shortest path and send the message to the source host
+                if (receiver->clock_wise_path_length < receiver->anti_clock_wise_path_length){
+                    // send the message to the source host
+                    frame->shortest_path_link = receiver->clock_wise_link;
                 }
-                // initialize the shortest_path_table_receiver for the first time for the dest host
-                if (init_receiver_table == 0){
-                    shortest_path_table_receiver[shortest_path_table_receiver_index].src = frame.src;
-                    shortest_path_table_receiver[shortest_path_table_receiver_index].received = 1;
-                    shortest_path_table_receiver[shortest_path_table_receiver_index].clock_wise_link = frame.link_used_in_src;
-                    shortest_path_table_receiver[shortest_path_table_receiver_index].clock_wise_path_length = frame.hop_count;
-                    shortest_path_table_receiver_index++;
+                else{
+                    // send the message to the source host
+                    frame->shortest_path_link = receiver->anti_clock_wise_link;
                 }
-                
-            // }
-            // else{
-            //     printf(">>2 BAD frame received:  checksums  (stored=%d, computed=%d)\n",stored_checksum, arriving_checksum);
-                
-            // }
-            int ackno = frame.seq;
-            transmit_frame(frame.src, NULL, 0, frame.seq, ackno, link, frame.shortest_path_link, frame.found_shortest_path);	// acknowledge the data
-            
+                frame->found_shortest_path = 1;
+            }
+            // initialize the shortest_path_table_receiver for the first time for the dest host
+            else if ((receiver = ADDRTABLE_insert(&shortest_path_table_receiver, frame->src)) != NULL){
+                receiver->src = frame->src;
+                receiver->received = 1;
+                receiver->clock_wise_link = frame->link_used_in_src;
+                receiver->clock_wise_path_length = frame->hop_count;
+            }
+
+            int ackno = frame->seq;
+            transmit_frame(frame->src, frame->seq, ackno, link, frame->shortest_path_link, frame->found_shortest_path);	// acknowledge the data
         }
     }
     else{
-        stored_checksum = CNET_ccitt((unsigned char *)&frame, len);
-        printf("non-consecutive; arriving_checksum: %d, stored_checksum: %d\n", frame.checksum, stored_checksum);
-        if (stored_checksum != frame.checksum) {
-            printf("BAD frame received:  checksums  (stored=%d, computed=%d)\n",stored_checksum, frame.checksum);
-            return;           // bad checksum, just ignore frame
-        }
         //  IF THE FRAME IS NOT ADDRESSED TO ME, send it to the next hop
         for(int i = 1; i <= nodeinfo.nlinks; i++){
             if (i != link){
-                transmit_frame_to_next_hop(frame, i);
+                transmit_frame_to_next_hop(frame, len, i);
                 break;
             }
         }
@@ -381,34 +476,62 @@ EVENT_HANDLER(physical_ready)
 
 }
 
-//  WHEN A TIMEOUT OCCURS, WE RE-TRANSMIT THE MOST RECENT DATA (MESSAGE)
-EVENT_HANDLER(timeouts)
+//  PROCESS THE ARRIVAL OF A NEW FRAME, READ INTO A BUFFER OF ITS OWN SO IT CAN BE FORWARDED
+//  WITHOUT BEING COPIED
+EVENT_HANDLER(physical_ready)
 {
-    FRAME   lastframe;
-    // printf("timeout, seq=%i\n", ackexpected);
-    // void transmit_frame(CnetAddr destaddr, MSG *msg, size_t length, int seqno, int ackno)
-    int ackno = -1;
+    FRAME        *frame = FRAMEPOOL_alloc();
+    FRAME        discard;
+    int          link;
+    size_t	 len = sizeof(FRAME);
 
-    // Retrieve the value of i for this timer event
-    // int i;
-    // CNET_timer_data(1, (CnetData *)&i);
+    if (frame == NULL){
+        CHECK(CNET_read_physical(&link, &discard, &len));
+        LOG(LOG_ERROR, "out of memory, frame dropped\n");
+        return;
+    }
+    //  RECEIVE THE NEW FRAME
+    CHECK(CNET_read_physical(&link, frame, &len));
+    METRICS_count(M_RECEIVED);
+    METRICS_rx(link, len);
+    frame_arrived(frame, len, link);
+    FRAMEPOOL_release(frame);
+}
 
-    // lastframe = swconn[i].lastframe;
-    // transmit_frame(lastframe.dest, &lastframe.msg, lastframe.len, lastframe.seq, ackno, i, lastframe.shortest_path_link, lastframe.found_shortest_path);
+//  WHEN A TIMEOUT OCCURS, WE RE-TRANSMIT THE MOST RECENT DATA (MESSAGE) TO THAT HOST
+EVENT_HANDLER(timeouts)
+{
+    SWCONN  *conn = SWCONN_lookup((CnetAddr)data);
 
-    for (int i = 1; i <= nodeinfo.nlinks; i++){
-        lastframe = swconn[i].lastframe;
-        transmit_frame(lastframe.dest, &lastframe.msg, lastframe.len, lastframe.seq, ackno, i, lastframe.shortest_path_link, lastframe.found_shortest_path);
+    if (conn == NULL || conn->lasttimer != timer){
+        return;
     }
-
+    METRICS_count(M_TIMEOUT);
+    TRACE(TR_TIMEOUT, TK_DATA, nodeinfo.address, conn->dest, conn->ackexpected, -1, conn->link, 0);
+    send_lastframe(conn);
 }
 
 //  DISPLAY THE CURRENT SEQUENCE NUMBERS WHEN A BUTTON IS PRESSED
 EVENT_HANDLER(showstate)
 {
-    printf(
-    "\n\tackexpected\t= %i\n\tnextdatatosend\t= %i\n\tdataexpected\t= %i\n",ackexpected, nextdatatosend, dataexpected);
+    SWCONN      **conn;
+    int         slot = 0;
 
+    while ((conn = ADDRTABLE_next(&connections, &slot, NULL)) != NULL){
+        printf(
+        "\n\tdest\t\t= %i\n\tackexpected\t= %i\n\tnextframetosend\t= %i\n\tlastreceived\t= %i\n",
+            (*conn)->dest, (*conn)->ackexpected, (*conn)->nextframetosend, (int)(*conn)->received.top);
+    }
+    LINKQUEUE_show();
+    FRAMEPOOL_show();
+    METRICS_show();
+}
+
+//  AT THE END OF THE SIMULATION, LEAVE THE METRICS IN THE OUTPUT AND THE TRACE IN A FILE
+EVENT_HANDLER(shutdown_node)
+{
+    METRICS_dump();
+    TRACE_dump();
 }
 
 //  THIS FUNCTION IS CALLED ONCE, AT THE BEGINNING OF THE WHOLE SIMULATION
@@ -427,11 +550,15 @@ EVENT_HANDLER(reboot_node)
 
     CHECK(CNET_set_handler( EV_PHYSICALREADY,    physical_ready, 0));
     CHECK(CNET_set_handler( EV_TIMER1,           timeouts, 0));
-
-    for (int i = 1; i <= nodeinfo.nlinks; i++){
-        // init SWCONN
-        SWCONN_init(i);
-    }
+    CHECK(CNET_set_handler( EV_SHUTDOWN,         shutdown_node, 0));
+
+    ADDRTABLE_init(&connections, sizeof(SWCONN *));
+    FRAMEPOOL_init(sizeof(FRAME));
+    LINKQUEUE_init();
+    METRICS_init();
+    TRACE_init();
+    ADDRTABLE_init(&shortest_path_table_sender, sizeof(SHORTEST_PATH_TABLE_SENDER));
+    ADDRTABLE_init(&shortest_path_table_receiver, sizeof(SHORTEST_PATH_TABLE_RECEIVER));
 
 //  BIND A FUNCTION AND A LABEL TO ONE OF THE NODE'S BUTTONS
     CHECK(CNET_set_handler( EV_DEBUG0,           showstate, 0));
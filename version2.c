@@ -2,16 +2,55 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "addrtable.h"
+#include "checksum.h"
+#include "dupwindow.h"
+#include "dvroute.h"
+#include "framepool.h"
+#include "linkqueue.h"
+#include "lsroute.h"
+#include "metrics.h"
+#include "trace.h"
+
 /*  This is an implementation of a stop-and-wait data link protocol.
 
     This protocol provides a reliable data-link layer for a 2-node network.
     This protocol employs only data and acknowledgement frames -
     piggybacking and negative acknowledgements are not used.
 
+    Every host and router runs the distance-vector routing of dvroute.c,
+    and sends each frame along the shortest path to its destination, so
+    the protocol works on any topology, not just a ring. Build with
+    -DROUTING=ROUTING_LINK_STATE to use the link-state routing of
+    lsroute.c instead, whose paths take the least time rather than the
+    fewest hops. The topology's compile line must include dvroute.c,
+    lsroute.c and addrtable.c.
+
+    Frames are built in the wire format in buffers from the frame pool. A
+    message is read from the application straight into the payload of the
+    frame that will carry it, the frame is packed once, and every
+    retransmission sends that same buffer again. Frames that arrive are
+    forwarded, or delivered, from the buffer they were read into.
+
+    Sequence numbers count up modulo 2^SEQ_BITS. The receiver keeps a
+    duplicate window (dupwindow.c) for each host it hears from, so data
+    from one host never looks like a duplicate of data from another, and
+    a frame that arrives again after its ack was lost is acknowledged but
+    not delivered twice.
+
     It is based on Tanenbaum's 'protocol 4', 2nd edition, p227.
  */
 
-static void send_find_path_frame(CnetEvent ev, CnetTimerID timer, CnetData data);
+//  THE TWO WAYS OF FINDING ROUTES
+#define ROUTING_DISTANCE_VECTOR 0
+#define ROUTING_LINK_STATE      1
+
+#ifndef ROUTING
+#define ROUTING             ROUTING_DISTANCE_VECTOR
+#endif
+
+//  A FRAME THAT HAS PASSED THIS MANY NODES MUST BE GOING ROUND IN CIRCLES
+#define MAX_HOPS            16
 
 //  DATA FRAMES CARRY A MAXIMUM-SIZED PAYLOAD, OUR MESSAGE
 typedef struct {
@@ -19,23 +58,19 @@ typedef struct {
 } MSG;
 
 
-//  THE FORMAT OF A FRAME
+//  THE HEADER OF A FRAME IN MEMORY, FRAME_pack() AND FRAME_unpack() CONVERT IT TO AND FROM THE WIRE
+//  FORMAT. THE PAYLOAD IS NEVER COPIED OUT OF THE WIRE FORMAT, IT STAYS IN THE FRAME'S BUFFER
 typedef struct {
 //  THE FIRST FIELDS IN THE STRUCTURE DEFINE THE FRAME HEADER
     CnetAddr    src,dest; 	// source and destination node addresses
     size_t	    len;       	// the length of the msg field only
-    int         checksum;  	// checksum of the whole frame
-    int         seq;        // seq > 0 for valid data, else = -1
+    int         checksum;  	// internet checksum of the header, checked on every hop
+    int         datasum;    // checksum() of the msg field, only checked by the destination
+    int         seq;        // seq >= 0 for valid data, else = -1
     int         ack;        // ack > 0 for valid ack, else = -1 
-    int         Is_find_path_frame;  // 1 if the frame is a find path frame, 0 otherwise
-    //  fields for finding the shortest path
+    int         Is_route_update;  // 1 if the frame carries a routing message, 0 otherwise
     int         hop_count;  // an int value to store the hop count (how many nodes the message has passed through)
-    CnetAddr    host_list[14];  // an array to store the list of nodes that the message has passed through
-    int         host_list_index;  // an int value to store the index of the Host_list array
-    int         host_hop_count[14];  // an array to store the hop count of each node that the message has passed through
-    int         shortest_link;  // an int value to store the shortest link
-//  THE LAST FIELD IN THE FRAME IS THE PAYLOAD, OUR MESSAGE
-    MSG          msg;
+    int         shortest_link;  // the link the frame was last sent on
 } FRAME;
 
 
@@ -43,36 +78,61 @@ typedef struct {
 typedef struct {
     CnetAddr    src,dest; 	// source and destination connection addresses
     CnetTimerID lasttimer;
-    FRAME       lastframe;
-    int         ackexpected, frameexpected, nextframetosend;
-    //  fields for finding the shortest path   
-    int         found_shortest_path;  // 1 if the shortest path has been found, 0 otherwise
-    //  table for storing the shortest path
-    CnetAddr    host_list[14];  // an array to store the list of nodes that the message has passed through
-    int         host_hop_count[14];  // an array to store the hop count of each node that the message has passed through
-    int         hosts_num;  // an int value to store the number of hosts in the network
-
+    FRAME       lastframe;  // the header of the data frame waiting for its ack
+    unsigned char *lastwire;  // that frame in the wire format, a buffer from the frame pool
+    size_t      lastlen;  // its length on the wire
+    CnetTime    firstsent;  // when that frame was first sent
+    int         sends;  // how many times it has been sent
+    int         ackexpected, nextframetosend;  // the frame waiting for its ack, and the next one to dest
 } SWCONN;
 
 
 
+//  THE WIRE FORMAT OF A FRAME
+//
+//  A frame is not written as the FRAME struct, which is mostly padding and
+//  an empty payload. It starts with a packed header of
+//  WIRE_HEADER_SIZE bytes, multi-byte fields in network byte order:
+//
+//      0   flags       WIRE_ROUTE
+//      1   seq         signed, -1 if none
+//      2   ack         signed, -1 if none
+//      3   hop_count   bumped by every router, the frame is dropped at MAX_HOPS
+//      4   src         4 bytes
+//      8   dest        4 bytes
+//      12  len         2 bytes, the length of the payload
+//      14  checksum    2 bytes, inet_checksum of the header with this field 0
+//      16  datasum     4 bytes, checksum() of the payload
+//
+//  The payload follows the header, len bytes of it. The payload of a
+//  WIRE_ROUTE frame is a message for dvroute.c or lsroute.c.
+//
+//  Routers only check and rewrite the header, so forwarding costs the same
+//  whatever the size of the payload. The header checksum is patched, not
+//  recomputed, when a router bumps hop_count. The destination checks both.
+#define WIRE_HEADER_SIZE    20
+#define WIRE_ROUTE          0x01    // a routing update for the neighbour, not a message
+
+#define WIRE_MAX_SIZE       (WIRE_HEADER_SIZE + MAX_MESSAGE_SIZE)
+
+//  WHERE THE PAYLOAD GOES IN A FRAME
+#define WIRE_PAYLOAD(wire)  ((wire) + WIRE_HEADER_SIZE)
+
+
 //  SOME HELPFUL MACROS FOR COMMON CALCULATIONS
-#define FRAME_HEADER_SIZE	(sizeof(FRAME) - sizeof(MSG))
-#define FRAME_SIZE(frame)	(FRAME_HEADER_SIZE + frame.len)
-#define increment(seq)		seq = 1-seq
+#define SEQ_BITS            7       // the seq and ack bytes are signed, and -1 means none
+#define SEQ_MASK            ((1 << SEQ_BITS) - 1)
+#define increment(seq)		seq = (seq + 1) & SEQ_MASK
 
 
 //  STATE VARIABLES HOLDING INFORMATION ABOUT THE LAST MESSAGE
 SWCONN      swconn; // only one connection in this part
 
-MSG       	lastmsg;
-size_t		lastmsglength		= 0;
 CnetTimerID	lasttimer		= NULLTIMER;
 
-//  STATE VARIABLES HOLDING SEQUENCE NUMBERS
-int		nextdatatosend		= 0;
-int       	ackexpected		= 0;
-int		dataexpected		= 0;
+//  STATE VARIABLES HOLDING SEQUENCE NUMBERS, EACH HOST SEES ITS OWN UNBROKEN SEQUENCE FROM US
+ADDRTABLE   nextseq;    // an int for each host we have sent data to, the seq of the next frame to it
+ADDRTABLE   received;   // a DUPWINDOW for each host we have had data from
 
 
 //  A Function to print a frame
@@ -81,57 +141,194 @@ void FRAME_print (FRAME *f) {
      	    f->src, f->dest, f->seq, f->ack, f->len);
 }
 
+//  PRINT A FRAME AND WHAT HAPPENED TO IT, ONLY IF EVERY FRAME IS LOGGED
+#define FRAME_log(what, f)  do { if (LOG_LEVEL >= LOG_FRAME){ printf("%s:  ", (what)); FRAME_print(f); } } while (0)
+
+//  A ROUTING MESSAGE IS FLAGGED IN THE HEADER, AN ACK CARRIES THE SEQUENCE NUMBER IT ACKNOWLEDGES
+#define TRACE_KIND(f)       ((f)->Is_route_update ? TK_ROUTE : ((f)->ack > -1 ? TK_ACK : TK_DATA))
+#define TRACE_FRAME(ev, f, link, len)   TRACE((ev), TRACE_KIND(f), (f)->src, (f)->dest, (f)->seq, (f)->ack, (link), (len))
+
 //  A function to init the connection state
 void SWCONN_init(){
     swconn.src = nodeinfo.address;
     swconn.dest = -1;
     swconn.lasttimer = NULLTIMER;
+    swconn.lastwire = NULL;
+    swconn.lastlen = 0;
+    swconn.firstsent = 0;
+    swconn.sends = 0;
     swconn.ackexpected = 0;
-    swconn.frameexpected = 0;
     swconn.nextframetosend = 0;
-    swconn.found_shortest_path = 0;
-    swconn.hosts_num = 0;
-    
-    for (int i = 0; i < 14; i++){
-        swconn.host_list[i] = -1;
-        swconn.host_hop_count[i] = -1;
+}
+
+//  WRITE AND READ MULTI-BYTE FIELDS IN NETWORK BYTE ORDER
+static void put16(unsigned char *p, int v){
+    p[0] = (v >> 8) & 0xff;
+    p[1] = v & 0xff;
+}
+
+static void put32(unsigned char *p, CnetAddr v){
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static int get16(const unsigned char *p){
+    return (p[0] << 8) | p[1];
+}
+
+static CnetAddr get32(const unsigned char *p){
+    return (CnetAddr)(((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3]);
+}
+
+//  WRITE THE HEADER OF A FRAME IN THE WIRE FORMAT, IN FRONT OF ITS PAYLOAD WHICH IS ALREADY AT
+//  WIRE_PAYLOAD(wire), AND CHECKSUM BOTH, RETURN ITS LENGTH ON THE WIRE
+size_t FRAME_pack(FRAME *f, unsigned char *wire){
+    size_t n = WIRE_HEADER_SIZE;
+
+    wire[0] = f->Is_route_update ? WIRE_ROUTE : 0;
+    wire[1] = (unsigned char)f->seq;
+    wire[2] = (unsigned char)f->ack;
+    wire[3] = (unsigned char)f->hop_count;
+    put32(&wire[4], f->src);
+    put32(&wire[8], f->dest);
+    put16(&wire[12], (int)f->len);
+    put16(&wire[14], 0);
+
+    f->datasum = checksum(&wire[n], f->len);
+    put32(&wire[16], (CnetAddr)f->datasum);
+    f->checksum = inet_checksum(wire, n);
+    put16(&wire[14], f->checksum);
+    return n + f->len;
+}
+
+//  READ THE FIXED HEADER OF A FRAME IN THE WIRE FORMAT, WITHOUT CHECKING IT
+void FRAME_unpack_header(const unsigned char *wire, FRAME *f){
+    f->Is_route_update = (wire[0] & WIRE_ROUTE) != 0;
+    f->seq = (signed char)wire[1];
+    f->ack = (signed char)wire[2];
+    f->hop_count = wire[3];
+    f->src = get32(&wire[4]);
+    f->dest = get32(&wire[8]);
+    f->len = get16(&wire[12]);
+    f->checksum = get16(&wire[14]);
+    f->datasum = (int)get32(&wire[16]);
+}
+
+//  CHECK THE HEADER OF A FRAME IN THE WIRE FORMAT, RETURN WHERE THE PAYLOAD STARTS OR 0 IF THE
+//  HEADER IS DAMAGED
+size_t FRAME_check_header(unsigned char *wire, size_t n){
+    int     arriving_checksum, stored_checksum;
+    size_t  off = WIRE_HEADER_SIZE;
+
+    if (n < WIRE_HEADER_SIZE || off + get16(&wire[12]) != n){
+        return 0;
+    }
+
+    //  CALCULATE THE CHECKSUM OF THE ARRIVING HEADER, IGNORE IF INVALID
+    arriving_checksum = get16(&wire[14]);
+    put16(&wire[14], 0);
+    stored_checksum = inet_checksum(wire, off);
+    put16(&wire[14], arriving_checksum);
+    if (stored_checksum != arriving_checksum){
+        LOG(LOG_INFO, "BAD frame received:  header checksums  (stored=%d, computed=%d)\n", arriving_checksum, stored_checksum);
+        return 0;
+    }
+    return off;
+}
+
+//  CHECK THE HEADER OF A FRAME IN THE WIRE FORMAT AND READ IT, RETURN WHERE THE PAYLOAD STARTS
+//  OR 0 IF THE HEADER IS DAMAGED. THE PAYLOAD IS LEFT WHERE IT IS AND NOT CHECKED, ONLY ITS
+//  DESTINATION NEEDS TO DO THAT
+size_t FRAME_unpack(unsigned char *wire, size_t n, FRAME *f){
+    size_t  payload = FRAME_check_header(wire, n);
+
+    if (payload == 0){
+        return 0;
     }
+    FRAME_unpack_header(wire, f);
+    return payload;
 }
 
-void transmit_frame_to_next_hop(FRAME frame, int link){
-    // update the frame
-    frame.hop_count += 1;
-    frame.host_list[frame.host_list_index] = nodeinfo.address;
-    frame.host_hop_count[frame.host_list_index] = frame.hop_count;
-    frame.host_list_index += 1;
-
-    // send the frame to the next hop
-    size_t len = sizeof(FRAME);
-    CHECK(CNET_write_physical(link, &frame, &len));
-    printf("send frame to the next hop\n");
+//  SEND A ROUTING MESSAGE TO THE NEIGHBOUR ON link
+static void send_route_update(int link, const unsigned char *update, size_t len){
+    FRAME frame;
+    unsigned char *wire = FRAMEPOOL_alloc();
+
+    if (wire == NULL){
+        return;
+    }
+    frame.src = nodeinfo.address;
+    frame.dest = ALLNODES;
+    frame.seq = -1;
+    frame.ack = -1;
+    frame.len = len;
+    frame.hop_count = 0;
+    frame.Is_route_update = 1;
+    memcpy(WIRE_PAYLOAD(wire), update, len);
+
+    len = FRAME_pack(&frame, wire);
+    METRICS_count(M_SENT);
+    TRACE_FRAME(TR_SEND, &frame, link, len);
+    METRICS_tx(link, len);
+    LINKQUEUE_write(link, wire, len);
+    FRAMEPOOL_release(wire);
 }
-void transmit_msg_frame_to_next_hop(FRAME frame, int link){
+
+//  FORWARD A FRAME WHOSE HEADER HAS BEEN CHECKED. ONLY THE HOP COUNT AND THE HEADER CHECKSUM
+//  CHANGE, THE PAYLOAD IS SENT AS IT ARRIVED
+void transmit_msg_frame_to_next_hop(FRAME *frame, unsigned char *wire, size_t len, int link){
+    uint16_t oldword, newword;
+
     // transmit the frame to the next hop
-    if (frame.ack < 0){
-        if (frame.seq > -1){
+    if (frame->ack < 0){
+        if (frame->seq > -1){
             // DATA transmit
-            printf("DATA transmitted:  ");
-            FRAME_print (&frame);
+            FRAME_log("DATA transmitted", frame);
         }
     }
     else {
         // ACK transmit
-        printf("ACK sent:  ");
-        FRAME_print (&frame);
+        FRAME_log("ACK sent", frame);
     }
-    // tranmit the frame to the next hop
-    CHECK(CNET_write_physical(link, &frame, &frame.len));
+    // hop_count shares a 16-bit word of the header with ack, patch the checksum for that word
+    memcpy(&oldword, &wire[2], 2);
+    wire[3] = (unsigned char)(frame->hop_count + 1);
+    memcpy(&newword, &wire[2], 2);
+    put16(&wire[14], inet_checksum_update((uint16_t)get16(&wire[14]), oldword, newword));
+    METRICS_count(M_FORWARDED);
+    TRACE_FRAME(TR_FORWARD, frame, link, len);
+    METRICS_tx(link, len);
+    LINKQUEUE_write(link, wire, len);
+}
+
+//  THE LINK ON THE SHORTEST PATH TO dest, 0 FOR THIS NODE, -1 IF THERE IS NONE
+int next_hop(CnetAddr dest){
+    if (ROUTING == ROUTING_LINK_STATE){
+        return LSROUTE_link(dest);
+    }
+    return DVROUTE_link(dest);
+}
+
+//  THE LINK ON THE SHORTEST PATH TO dest, OR otherwise IF THERE IS NO ROUTE TO IT YET
+int route_link(CnetAddr dest, int otherwise){
+    int link = next_hop(dest);
+
+    return (link > 0) ? link : otherwise;
 }
 
-//  A FUNCTION TO TRANSMIT EITHER A DATA OR AN ACKNOWLEDGMENT FRAME
-void transmit_frame(CnetAddr destaddr, MSG *msg, size_t length, int seqno, int ackno, int link)
+//  A FUNCTION TO TRANSMIT AN ACKNOWLEDGMENT FRAME, DATA FRAMES ARE PACKED ONCE, IN swconn
+void transmit_frame(CnetAddr destaddr, int seqno, int ackno, int link)
 {
     FRAME       frame;
+    unsigned char *wire = FRAMEPOOL_alloc();
+    size_t      length;
+
+    if (wire == NULL){
+        LOG(LOG_ERROR, "out of memory, ack to %d dropped\n", destaddr);
+        return;
+    }
 
 //  INITIALISE THE FRAME'S HEADER FIELDS
     frame.src       = nodeinfo.address;
@@ -139,41 +336,53 @@ void transmit_frame(CnetAddr destaddr, MSG *msg, size_t length, int seqno, int a
     frame.seq       = seqno;
     frame.ack       = ackno;
     frame.checksum  = 0;
-    frame.len       = length;
+    frame.len       = 0;
+    frame.hop_count = 0;
     frame.shortest_link = link;
-    frame.Is_find_path_frame = 0;
+    frame.Is_route_update = 0;
 
-    
+    // ACK transmit, with no payload
+    FRAME_log("ACK sent", &frame);
+    length = FRAME_pack(&frame, wire);
 
-    if (ackno < 0){
-        if (seqno > -1){
-            // DATA transmit
-            CnetTime	timeout;
+//  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
+    LOG(LOG_FRAME, "sending frame checksum: %d\n", frame.checksum);
 
-            printf("DATA transmitted:  ");
-            FRAME_print (&frame);
-            memcpy(&frame.msg, msg, length);
+    METRICS_count(M_SENT);
+    TRACE_FRAME(TR_SEND, &frame, link, length);
+    METRICS_tx(link, length);
+    LINKQUEUE_write(link, wire, length);
+    FRAMEPOOL_release(wire);
+}
 
-        
-            timeout =
-                FRAME_SIZE(frame)*((CnetTime)8000000 / linkinfo[link].bandwidth) +
-                        linkinfo[link].propagationdelay;
+//  SEND THE DATA FRAME WAITING FOR ITS ACK ON link AND START ITS TIMER. THE FRAME WAS PACKED
+//  WHEN ITS MESSAGE ARRIVED, AND THE HEADER DOES NOT NAME THE LINK, SO EVERY TRANSMISSION
+//  SENDS THE SAME BUFFER
+void send_lastframe(int link)
+{
+    CnetTime	timeout;
 
-            swconn.lasttimer = CNET_start_timer(EV_TIMER1, 9 * timeout, 0);
-        }
+    swconn.lastframe.shortest_link = link;
+    if (swconn.sends++ == 0){
+        swconn.firstsent = nodeinfo.time_in_usec;
     }
     else {
-        // ACK transmit
-        printf("ACK sent:  ");
-        FRAME_print (&frame);
+        METRICS_count(M_RETRANSMIT);
     }
+    FRAME_log("DATA transmitted", &swconn.lastframe);
+
+    timeout =
+        swconn.lastlen*((CnetTime)8000000 / linkinfo[link].bandwidth) +
+                linkinfo[link].propagationdelay;
+    swconn.lasttimer = CNET_start_timer(EV_TIMER1, 9 * timeout, 0);
 
 //  FINALLY, WRITE THE FRAME TO THE PHYSICAL LAYER
-    length		= FRAME_SIZE(frame);
-    frame.checksum	= CNET_ccitt((unsigned char *)&frame, length);
-    printf("sending frame checksum: %d\n", frame.checksum);
+    LOG(LOG_FRAME, "sending frame checksum: %d\n", swconn.lastframe.checksum);
 
-    CHECK(CNET_write_physical(link, &frame, &length));
+    METRICS_count(M_SENT);
+    TRACE_FRAME(swconn.sends > 1 ? TR_RESEND : TR_SEND, &swconn.lastframe, link, swconn.lastlen);
+    METRICS_tx(link, swconn.lastlen);
+    LINKQUEUE_write(link, swconn.lastwire, swconn.lastlen);
 }
 
 //  THE APPLICATION LAYER HAS A NEW MESSAGE TO BE DELIVERED
@@ -184,172 +393,223 @@ EVENT_HANDLER(application_ready)
     // printf("application ready\n");
 
     CnetAddr destaddr;
-    FRAME    frame;
-    int     shortest_link;
-    lastmsglength  = sizeof(MSG);
+    FRAME    *frame = &swconn.lastframe;
+    int      *seq;
+    unsigned char *wire = FRAMEPOOL_alloc();
+    size_t   length = MAX_MESSAGE_SIZE;
+    MSG      discard;
+
+    if (wire == NULL){
+        // the message must still be taken, or the application layer stalls
+        CHECK(CNET_read_application(&destaddr, &discard, &length));
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        return;
+    }
 
-    // read the message from the application layer
-    CHECK(CNET_read_application(&destaddr, &lastmsg, &lastmsglength));
-    printf("\n>>>>>> ready to transmit the message!!!\n");
+    // read the message from the application layer, straight into the frame that will carry it
+    CHECK(CNET_read_application(&destaddr, WIRE_PAYLOAD(wire), &length));
+    LOG(LOG_FRAME, "\n>>>>>> ready to transmit the message!!!\n");
+    if ((seq = ADDRTABLE_insert(&nextseq, destaddr)) == NULL){
+        LOG(LOG_ERROR, "out of memory, message to %d dropped\n", destaddr);
+        FRAMEPOOL_release(wire);
+        return;
+    }
 
     CNET_disable_application(ALLNODES);
 
-    // find the shortest path to the destination!
-    // and find the link lead to the shortest path!
-    for (int i = 0; i < 14; i++ ){
-        if (swconn.host_list[i] == destaddr){
-            if (swconn.hosts_num - swconn.host_hop_count[i] > swconn.host_hop_count[i]){
-                shortest_link = 1;
-            }
-            else{
-                shortest_link = 2;
-            }
-            break;
-        }
-        else{
-            shortest_link = 1;
-        }
-    }
-
-    // transmit the frame
-    int ackno = -1;
-    transmit_frame(destaddr, &lastmsg, lastmsglength, nextdatatosend, ackno, shortest_link);
-    // add to swconn
+    // build the frame once, in swconn, every transmission of it sends the same buffer
     swconn.dest = destaddr;
-    frame.src       = nodeinfo.address;
-    frame.dest      = destaddr;
-    frame.seq       = nextdatatosend;
-    frame.ack       = ackno;
-    // frame.checksum  = 0;
-    frame.len       = lastmsglength;
-    frame.shortest_link = shortest_link;
-    frame.Is_find_path_frame = 0;
-    memcpy(&frame.msg, &lastmsg, lastmsglength);
-    swconn.lastframe = frame;
-    // increment # for nextdatatosend
-    increment(nextdatatosend);
-    // add to swconn
-    swconn.nextframetosend = nextdatatosend;
-    
+    frame->src       = nodeinfo.address;
+    frame->dest      = destaddr;
+    frame->seq       = *seq;
+    frame->ack       = -1;
+    frame->checksum  = 0;
+    frame->len       = length;
+    frame->hop_count = 0;
+    frame->Is_route_update = 0;
+    FRAMEPOOL_release(swconn.lastwire);
+    swconn.lastwire = wire;
+    swconn.lastlen = FRAME_pack(frame, wire);
+    swconn.sends = 0;
+    swconn.ackexpected = frame->seq;
+    increment(*seq);
+    swconn.nextframetosend = *seq;
+
+    // send the frame along the shortest path, or on link 1 until the routes are known
+    send_lastframe(route_link(destaddr, 1));
 }
 
-//  PROCESS THE ARRIVAL OF A NEW FRAME, VERIFY CHECKSUM, ACT ON ITS FRAMEKIND
-EVENT_HANDLER(physical_ready)
+//  CHECK A NEW FRAME AND ACT ON IT. wire IS ITS OWN BUFFER FROM THE FRAME POOL, SO IT IS
+//  FORWARDED AS IT IS AND A MESSAGE IS DELIVERED STRAIGHT FROM IT
+void frame_arrived(unsigned char *wire, size_t len, int link)
 {
     FRAME        frame;
-    int          link;
-    int          arriving_checksum, stored_checksum;
-    size_t	 len = sizeof(FRAME);
+    size_t       payload;
 
-    //  RECEIVE THE NEW FRAME
-    CHECK(CNET_read_physical(&link, &frame, &len));
-
-    //  check if the frame is carrying message or just finding shortest path
-    if (frame.Is_find_path_frame == 1){
-        // handle the frame that is finding shortest path
-
-        // find if the frame is back to the src or not
-        // if not, forward the frame to the next hop
-        if (frame.src != nodeinfo.address){
-            // forward the frame to the next hop and update the frame
-            for(int i = 1; i <= nodeinfo.nlinks; i++){
-                if (i != link){
-                    transmit_frame_to_next_hop(frame, i);
-                    break;
-                }
-            }
+    if (len < WIRE_HEADER_SIZE){
+        return;
+    }
+    FRAME_unpack_header(wire, &frame);
+
+    //  check if the frame is carrying message or a routing update from a neighbour
+    if (frame.Is_route_update == 1){
+        payload = FRAME_unpack(wire, len, &frame);
+        if (payload == 0 || checksum(&wire[payload], frame.len) != frame.datasum){
+            METRICS_count(M_BADCHECKSUM);
+            TRACE(TR_BADCHECKSUM, payload == 0 ? TK_UNKNOWN : TK_ROUTE, -1, -1, -1, -1, link, len);
+            return;           // bad update, just ignore frame
         }
-        else{
-            // if back to the src, store the table into swconn
-            swconn.found_shortest_path = 1;
-            swconn.hosts_num = frame.hop_count;
-            // swconn.host_list = frame.host_list;
-            // swconn.host_hop_count = frame.host_hop_count;
-            for (int i = 0; i < 14 ; i++){
-                swconn.host_list[i] = frame.host_list[i];
-                swconn.host_hop_count[i] = frame.host_hop_count[i];
-            }
-            
-            // print the table
-            // printf("Shortest path table:\n");
-            // for (int i = 0; i < 14 ; i++){
-            //     printf("host_list[%d] = %d, host_hop_count[%d] = %d\n", i, swconn.host_list[i], i, swconn.host_hop_count[i]);
-            // }
+        TRACE_FRAME(TR_RECEIVE, &frame, link, len);
+        if (ROUTING == ROUTING_LINK_STATE){
+            LSROUTE_receive(link, &wire[payload], frame.len);
+        }
+        else {
+            DVROUTE_receive(link, &wire[payload], frame.len);
         }
     }
     else{
         // handle the frame that is carrying message
         //  if the frame.dest is not the node, forward the frame to the next hop
         if (frame.dest == nodeinfo.address){
-            //  CALCULATE THE CHECKSUM OF THE ARRIVING FRAME, IGNORE IF INVALID
-            arriving_checksum	= frame.checksum;
-            frame.checksum  	= 0;
-            stored_checksum = CNET_ccitt((unsigned char *)&frame, len);
-            if(stored_checksum != arriving_checksum) {
-                printf("BAD frame received:  checksums  (stored=%d, computed=%d)\n", arriving_checksum, stored_checksum);
+            //  CHECK AND UNPACK THE ARRIVING FRAME, IGNORE IF INVALID
+            payload = FRAME_unpack(wire, len, &frame);
+            if (payload == 0){
+                METRICS_count(M_BADCHECKSUM);
+                TRACE(TR_BADCHECKSUM, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+                return;           // bad checksum, just ignore frame
+            }
+            TRACE_FRAME(TR_RECEIVE, &frame, link, len);
+            if (checksum(&wire[payload], frame.len) != frame.datasum){
+                LOG(LOG_INFO, "BAD frame received:  payload checksum\n");
+                METRICS_count(M_BADCHECKSUM);
+                TRACE_FRAME(TR_BADCHECKSUM, &frame, link, len);
                 return;           // bad checksum, just ignore frame
             }
             //  use if statement to determine if frame is data or ack
             if (frame.ack > -1){
                 // ACK receive
-                if(frame.seq == ackexpected) {
-                    printf("ACK received:  ");
-                    FRAME_print (&frame);
+                if (swconn.lastwire != NULL && frame.src == swconn.dest && frame.seq == swconn.ackexpected){
+                    FRAME_log("ACK received", &frame);
                     CNET_stop_timer(swconn.lasttimer);
-                    increment(ackexpected);
-                    // add to swconn
-                    swconn.ackexpected = ackexpected;
+                    // only a frame sent once gives a round trip time that can be trusted (Karn)
+                    if (swconn.sends == 1){
+                        METRICS_sample(H_RTT, nodeinfo.time_in_usec - swconn.firstsent);
+                    }
+                    METRICS_sample(H_ACKED, nodeinfo.time_in_usec - swconn.firstsent);
+                    swconn.ackexpected = swconn.nextframetosend;
+                    FRAMEPOOL_release(swconn.lastwire);
+                    swconn.lastwire = NULL;
                     CNET_enable_application(ALLNODES);
                 }
             }
             else {
                 // DATA receive
-                if(frame.seq == dataexpected) {
-                    printf("DATA received:  ");
-                    FRAME_print (&frame);
+                DUPWINDOW *window = ADDRTABLE_find(&received, frame.src);
+
+                if (window == NULL && (window = ADDRTABLE_insert(&received, frame.src)) != NULL){
+                    DUPWINDOW_init(window, SEQ_BITS);
+                }
+                if (window != NULL && DUPWINDOW_accept(window, frame.seq)) {
+                    FRAME_log("DATA received", &frame);
                     len = frame.len;
-                    CHECK(CNET_write_application(&frame.msg, &len));
-                    increment(dataexpected);
-                    // add to swconn
-                    swconn.frameexpected = dataexpected;
-                    // int ackno = frame.seq;                
-                    // transmit_frame(frame.src, NULL, 0, frame.seq, ackno, link);	// acknowledge the data
+                    CHECK(CNET_write_application(&wire[payload], &len));
+                    METRICS_count(M_DELIVERED);
+                    TRACE_FRAME(TR_DELIVER, &frame, 0, len);
+                }
+                else {
+                    METRICS_count(M_DUPLICATE);
+                    TRACE_FRAME(TR_DUPLICATE, &frame, link, len);
                 }
-                // else
-                    // printf(">> 2 << BAD frame received:  checksums  (stored=%d, computed=%d)\n", arriving_checksum, stored_checksum);
                 int ackno = frame.seq;                
-                transmit_frame(frame.src, NULL, 0, frame.seq, ackno, link);	// acknowledge the data
+                transmit_frame(frame.src, frame.seq, ackno, route_link(frame.src, link));	// acknowledge the data
             }
         }
         else{
-            // forward the frame to the next hop
-            for(int i = 1; i <= nodeinfo.nlinks; i++){
-                if (i != link){
-                    transmit_msg_frame_to_next_hop(frame, i);
-                    break;
-                }
+            // forward the frame along the shortest path, if its header is intact
+            size_t hdrlen = FRAME_check_header(wire, len);
+            int    next = next_hop(frame.dest);
+
+            if (hdrlen == 0){
+                METRICS_count(M_BADCHECKSUM);
+                TRACE(TR_BADCHECKSUM, TK_UNKNOWN, -1, -1, -1, -1, link, len);
+                return;
+            }
+            TRACE_FRAME(TR_RECEIVE, &frame, link, len);
+            if (next <= 0 || frame.hop_count + 1 >= MAX_HOPS){
+                LOG(LOG_ERROR, "no route to %d, frame dropped\n", frame.dest);
+                TRACE_FRAME(TR_DROP, &frame, link, len);
+                return;
             }
+            transmit_msg_frame_to_next_hop(&frame, wire, len, next);
         }
     }
 }
 
+//  PROCESS THE ARRIVAL OF A NEW FRAME, READ INTO A BUFFER OF ITS OWN
+EVENT_HANDLER(physical_ready)
+{
+    unsigned char *wire = FRAMEPOOL_alloc();
+    unsigned char discard[WIRE_MAX_SIZE];
+    int          link;
+    size_t	 len = WIRE_MAX_SIZE;
+
+    if (wire == NULL){
+        CHECK(CNET_read_physical(&link, discard, &len));
+        LOG(LOG_ERROR, "out of memory, frame dropped\n");
+        return;
+    }
+    //  RECEIVE THE NEW FRAME
+    CHECK(CNET_read_physical(&link, wire, &len));
+    METRICS_count(M_RECEIVED);
+    METRICS_rx(link, len);
+    frame_arrived(wire, len, link);
+    FRAMEPOOL_release(wire);
+}
+
 //  WHEN A TIMEOUT OCCURS, WE RE-TRANSMIT THE MOST RECENT DATA (MESSAGE)
 EVENT_HANDLER(timeouts)
 {
-    FRAME   lastframe;
-    
-    int ackno = -1;
-
-    lastframe = swconn.lastframe;
-    transmit_frame(lastframe.dest, &lastframe.msg, lastframe.len, lastframe.seq, ackno, lastframe.shortest_link);
+    if (swconn.lastwire == NULL){
+        return;
+    }
+    METRICS_count(M_TIMEOUT);
+    TRACE(TR_TIMEOUT, TK_DATA, nodeinfo.address, swconn.lastframe.dest, swconn.lastframe.seq, -1,
+        swconn.lastframe.shortest_link, 0);
+    // the route may have changed since the frame was first sent
+    send_lastframe(route_link(swconn.lastframe.dest, swconn.lastframe.shortest_link));
 }
 
 //  DISPLAY THE CURRENT SEQUENCE NUMBERS WHEN A BUTTON IS PRESSED
 EVENT_HANDLER(showstate)
 {
-    printf(
-    "\n\tackexpected\t= %i\n\tnextdatatosend\t= %i\n\tdataexpected\t= %i\n",
-		    ackexpected, nextdatatosend, dataexpected);
+    DUPWINDOW   *window;
+    CnetAddr    addr;
+    int         slot = 0, *seq;
+
+    printf("\n\tackexpected\t= %i to %d\n", swconn.ackexpected, swconn.dest);
+    while ((seq = ADDRTABLE_next(&nextseq, &slot, &addr)) != NULL){
+        printf("\tnextdatatosend to %d\t= %i\n", addr, *seq);
+    }
+    slot = 0;
+    while ((window = ADDRTABLE_next(&received, &slot, &addr)) != NULL){
+        printf("\tlastreceived from %d\t= %i\n", addr, (int)window->top);
+    }
+    if (ROUTING == ROUTING_LINK_STATE){
+        LSROUTE_show();
+    }
+    else {
+        DVROUTE_show();
+    }
+    LINKQUEUE_show();
+    FRAMEPOOL_show();
+    METRICS_show();
+}
+
+//  AT THE END OF THE SIMULATION, LEAVE THE METRICS IN THE OUTPUT AND THE TRACE IN A FILE
+EVENT_HANDLER(shutdown_node)
+{
+    METRICS_dump();
+    TRACE_dump();
 }
 
 //  THIS FUNCTION IS CALLED ONCE, AT THE BEGINNING OF THE WHOLE SIMULATION
@@ -358,15 +618,10 @@ EVENT_HANDLER(reboot_node)
     //  INDICATE THE EVENTS OF INTEREST FOR THIS PROTOCOL
     if (nodeinfo.nodetype == NT_HOST) {
         CHECK(CNET_set_handler( EV_APPLICATIONREADY, application_ready, 0));
-        
-        // send find patt message to the linked node
-        CNET_set_handler(EV_TIMER2, send_find_path_frame, 0);
-            
-        // Request EV_TIMER2 in 1 sec, ignore return value
-        CNET_start_timer (EV_TIMER2, 1000000, 0);
     }
     CHECK(CNET_set_handler( EV_PHYSICALREADY,    physical_ready, 0));
     CHECK(CNET_set_handler( EV_TIMER1,           timeouts, 0));
+    CHECK(CNET_set_handler( EV_SHUTDOWN,         shutdown_node, 0));
 
 //  BIND A FUNCTION AND A LABEL TO ONE OF THE NODE'S BUTTONS
     CHECK(CNET_set_handler( EV_DEBUG0,           showstate, 0));
@@ -377,26 +632,19 @@ EVENT_HANDLER(reboot_node)
 
     // init SWCONN
     SWCONN_init();
-}
-
-
-static EVENT_HANDLER(send_find_path_frame){
-    FRAME frame;
-    frame.src = nodeinfo.address;
-    frame.hop_count = 0;
-    frame.host_list_index = 0;
-    frame.Is_find_path_frame = 1;
-    // frame.checksum = 0;
-
-    // if the shortes path table is not empty, then send the table to the linked node
-    if (swconn.found_shortest_path == 0){
-        // send this frame to the linked node with link number 1
-        size_t len = sizeof(FRAME);
-        // frame.checksum = CNET_ccitt((unsigned char *)&frame, len);
-        CHECK(CNET_write_physical(1, &frame, &len));
-        printf("send find path frame to the host with link == 1\n");
-        // Request EV_TIMER2 in 8 sec, ignore return value
-        // CNET_start_timer (EV_TIMER2, 15000000, 0);
+    ADDRTABLE_init(&received, sizeof(DUPWINDOW));
+    ADDRTABLE_init(&nextseq, sizeof(int));
+    FRAMEPOOL_init(WIRE_MAX_SIZE);
+    LINKQUEUE_init();
+    METRICS_init();
+    TRACE_init();
+
+    // hosts and routers alike learn their routes from their neighbours
+    if (ROUTING == ROUTING_LINK_STATE){
+        LSROUTE_init(send_route_update);
+    }
+    else {
+        DVROUTE_init(send_route_update);
     }
 }
 